@@ -7,6 +7,7 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -227,11 +228,13 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
   c = d->channel;
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
+  TRACE (TRACE_DISK_START, sec_no, false);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
   input_sector (c, buffer);
+  TRACE (TRACE_DISK_DONE, sec_no, false);
   d->read_cnt++;
   lock_release (&c->lock);
 }
@@ -252,11 +255,13 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
   c = d->channel;
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
+  TRACE (TRACE_DISK_START, sec_no, true);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
   output_sector (c, buffer);
   sema_down (&c->completion_wait);
+  TRACE (TRACE_DISK_DONE, sec_no, true);
   d->write_cnt++;
   lock_release (&c->lock);
 }
@@ -9,6 +9,8 @@
 #include "devices/disk.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -195,3 +197,108 @@ fsutil_get (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Writes the profiler's samples to file ARGV[1], in the format
+   described in threads/profile.h.  Sampling stops while they are
+   written. */
+void
+fsutil_dump_profile (char **argv)
+{
+  const char *file_name = argv[1];
+  bool was_enabled = profile_enabled;
+  struct profile_sample *buffer;
+  size_t per_page = PGSIZE / sizeof *buffer;
+  size_t cnt, i;
+  struct file *dst;
+  uint32_t header[2];
+
+  printf ("Dumping profile to '%s'...\n", file_name);
+  profile_enabled = false;
+  cnt = profile_sample_cnt ();
+
+  if (!filesys_create (file_name, sizeof header + cnt * sizeof *buffer))
+    PANIC ("%s: create failed", file_name);
+  dst = filesys_open (file_name);
+  if (dst == NULL)
+    PANIC ("%s: open failed", file_name);
+  buffer = palloc_get_page (PAL_ASSERT);
+
+  memcpy (&header[0], "PROF", 4);
+  header[1] = cnt;
+  if (file_write (dst, header, sizeof header) != sizeof header)
+    PANIC ("%s: write failed", file_name);
+  for (i = 0; i < cnt; i += per_page)
+    {
+      size_t n = cnt - i < per_page ? cnt - i : per_page;
+      size_t j;
+
+      for (j = 0; j < n; j++)
+        profile_get (i + j, &buffer[j]);
+      if (file_write (dst, buffer, n * sizeof *buffer)
+          != (off_t) (n * sizeof *buffer))
+        PANIC ("%s: write failed", file_name);
+    }
+  printf ("%zu samples written.\n", cnt);
+
+  palloc_free_page (buffer);
+  file_close (dst);
+  profile_enabled = was_enabled;
+}
+
+/* Writes the trace records to file ARGV[1].  The file holds
+   "TRCE", the number of event types as a 32-bit integer, each
+   event type's name in a 16-byte field, the number of records as
+   a 32-bit integer, and then the records, as struct
+   trace_record, all little-endian.  Tracing stops while they are
+   written. */
+void
+fsutil_dump_trace (char **argv)
+{
+  const char *file_name = argv[1];
+  bool was_enabled = trace_enabled;
+  struct trace_record *buffer;
+  size_t per_page = PGSIZE / sizeof *buffer;
+  char names[TRACE_EVENT_CNT][16];
+  uint32_t header[2];
+  uint32_t cnt;
+  size_t i;
+  struct file *dst;
+
+  printf ("Dumping trace to '%s'...\n", file_name);
+  trace_enabled = false;
+  cnt = trace_record_cnt ();
+
+  if (!filesys_create (file_name, sizeof header + sizeof names + sizeof cnt
+                       + cnt * sizeof *buffer))
+    PANIC ("%s: create failed", file_name);
+  dst = filesys_open (file_name);
+  if (dst == NULL)
+    PANIC ("%s: open failed", file_name);
+  buffer = palloc_get_page (PAL_ASSERT);
+
+  memcpy (&header[0], "TRCE", 4);
+  header[1] = TRACE_EVENT_CNT;
+  memset (names, 0, sizeof names);
+  for (i = 0; i < TRACE_EVENT_CNT; i++)
+    strlcpy (names[i], trace_event_names[i], sizeof names[i]);
+  if (file_write (dst, header, sizeof header) != sizeof header
+      || file_write (dst, names, sizeof names) != sizeof names
+      || file_write (dst, &cnt, sizeof cnt) != sizeof cnt)
+    PANIC ("%s: write failed", file_name);
+  for (i = 0; i < cnt; i += per_page)
+    {
+      size_t n = cnt - i < per_page ? cnt - i : per_page;
+      size_t j;
+
+      for (j = 0; j < n; j++)
+        trace_get (i + j, &buffer[j]);
+      if (file_write (dst, buffer, n * sizeof *buffer)
+          != (off_t) (n * sizeof *buffer))
+        PANIC ("%s: write failed", file_name);
+    }
+  printf ("%u records written.\n", (unsigned) cnt);
+
+  palloc_free_page (buffer);
+  file_close (dst);
+  trace_enabled = was_enabled;
+}
@@ -0,0 +1,19 @@
+#ifndef __LIB_THREAD_STATS_H
+#define __LIB_THREAD_STATS_H
+
+#include <stdint.h>
+
+/* Scheduling statistics for one thread, as returned by the
+   thread_stats() system call.  Times in ticks are timer ticks;
+   times in cycles are time-stamp counter cycles. */
+struct thread_stats
+  {
+    int64_t now;                /* Timer ticks since boot. */
+    int64_t run_ticks;          /* Ticks spent running. */
+    uint64_t ready_cycles;      /* Time spent ready but not running. */
+    uint64_t lock_wait_cycles;  /* Time spent blocked on locks. */
+    unsigned voluntary_switches;   /* Switches away to block or exit. */
+    unsigned involuntary_switches; /* Switches away while runnable. */
+  };
+
+#endif /* lib/thread-stats.h */
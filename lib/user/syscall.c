@@ -182,3 +182,56 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+set_tickets (int tickets) 
+{
+  return syscall1 (SYS_SET_TICKETS, tickets);
+}
+
+bool
+thread_stats (struct thread_stats *stats) 
+{
+  return syscall1 (SYS_THREAD_STATS, stats);
+}
+
+static void thread_start (void (*func) (void *aux), void *aux) NO_RETURN;
+
+/* Runs FUNC(AUX) in a new thread, then ends the thread. */
+static void
+thread_start (void (*func) (void *aux), void *aux)
+{
+  func (aux);
+  thread_exit ();
+}
+
+tid_t
+thread_create (void (*func) (void *aux), void *aux)
+{
+  return syscall3 (SYS_THREAD_CREATE, thread_start, func, aux);
+}
+
+void
+thread_exit (void)
+{
+  syscall0 (SYS_THREAD_EXIT);
+  NOT_REACHED ();
+}
+
+int
+thread_join (tid_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
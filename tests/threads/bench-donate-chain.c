@@ -0,0 +1,85 @@
+/* Measures priority donation through a chain of DEPTH locks.
+   In each round the main thread holds the first lock while
+   DEPTH threads of increasing priority each take their own lock
+   and then wait for the previous thread's, so that every one of
+   them donates its priority down the chain to the main thread.
+   Then the main thread releases its lock and the chain unwinds. */
+
+#include <stdio.h>
+#include "tests/threads/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define DEPTH 8
+#define ROUND_CNT 500
+
+struct chain
+  {
+    struct lock locks[DEPTH];   /* Thread I holds lock I, wants I - 1. */
+    struct semaphore done;      /* Upped by each finished thread. */
+  };
+
+struct link
+  {
+    struct chain *chain;
+    int id;                     /* 1...DEPTH. */
+  };
+
+static thread_func link_thread;
+
+void
+test_bench_donate_chain (void)
+{
+  struct chain chain;
+  struct link links[DEPTH + 1];
+  struct bench b;
+  int round, i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  for (i = 0; i < DEPTH; i++)
+    lock_init (&chain.locks[i]);
+  sema_init (&chain.done, 0);
+
+  bench_start (&b);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      lock_acquire (&chain.locks[0]);
+      for (i = 1; i <= DEPTH; i++)
+        {
+          char name[16];
+          links[i].chain = &chain;
+          links[i].id = i;
+          snprintf (name, sizeof name, "link %d", i);
+          thread_create (name, PRI_DEFAULT + i, link_thread, &links[i]);
+        }
+      if (thread_get_priority () != PRI_DEFAULT + DEPTH)
+        fail ("priority %d after donation, expected %d",
+              thread_get_priority (), PRI_DEFAULT + DEPTH);
+      lock_release (&chain.locks[0]);
+      for (i = 1; i <= DEPTH; i++)
+        sema_down (&chain.done);
+    }
+  bench_report (&b, "depth-8 donation chains", ROUND_CNT);
+}
+
+static void
+link_thread (void *link_)
+{
+  struct link *link = link_;
+  struct chain *chain = link->chain;
+
+  if (link->id < DEPTH)
+    lock_acquire (&chain->locks[link->id]);
+  lock_acquire (&chain->locks[link->id - 1]);
+  lock_release (&chain->locks[link->id - 1]);
+  if (link->id < DEPTH)
+    lock_release (&chain->locks[link->id]);
+  sema_up (&chain->done);
+}
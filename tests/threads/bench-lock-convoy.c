@@ -0,0 +1,75 @@
+/* Measures lock throughput under contention.  THREAD_CNT
+   threads of equal priority each acquire and release one lock
+   ACQUIRE_CNT times.  Every few acquisitions the holder yields
+   while still holding the lock, so that the others pile up
+   behind it in a convoy, as they would if it were preempted. */
+
+#include <stdio.h>
+#include "tests/threads/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 8
+#define ACQUIRE_CNT 2000
+#define YIELD_EVERY 8
+
+struct convoy
+  {
+    struct lock lock;           /* The contended lock. */
+    long long acquires;         /* Protected by lock. */
+    struct semaphore done;      /* Upped by each finished thread. */
+  };
+
+static thread_func convoy_thread;
+
+void
+test_bench_lock_convoy (void)
+{
+  struct convoy c;
+  struct bench b;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&c.lock);
+  c.acquires = 0;
+  sema_init (&c.done, 0);
+
+  /* Stay above the threads so that we can start them all before
+     any of them runs. */
+  thread_set_priority (PRI_DEFAULT + 1);
+  bench_start (&b);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "convoy %d", i);
+      thread_create (name, PRI_DEFAULT, convoy_thread, &c);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&c.done);
+  bench_report (&b, "contended lock acquires", c.acquires);
+  thread_set_priority (PRI_DEFAULT);
+
+  if (c.acquires != THREAD_CNT * ACQUIRE_CNT)
+    fail ("%lld acquires, expected %d", c.acquires, THREAD_CNT * ACQUIRE_CNT);
+}
+
+static void
+convoy_thread (void *c_)
+{
+  struct convoy *c = c_;
+  int i;
+
+  for (i = 0; i < ACQUIRE_CNT; i++)
+    {
+      lock_acquire (&c->lock);
+      c->acquires++;
+      if (i % YIELD_EVERY == 0)
+        thread_yield ();
+      lock_release (&c->lock);
+    }
+  sema_up (&c->done);
+}
@@ -0,0 +1,94 @@
+/* Measures malloc() and free() throughput: first one thread
+   allocating and freeing one block at a time, which the per-CPU
+   magazines should serve without taking a lock; then one thread
+   holding many blocks of mixed sizes at once, which moves blocks
+   between the magazines and the descriptors; then THREAD_CNT
+   threads of equal priority allocating and freeing at the same
+   time. */
+
+#include <stdio.h>
+#include "tests/threads/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define PAIR_CNT 50000
+#define BATCH_SIZE 256
+#define BATCH_CNT 100
+#define THREAD_CNT 4
+
+static void alloc_pairs (int cnt, size_t size);
+static thread_func pairs_thread;
+
+void
+test_bench_malloc (void)
+{
+  static void *blocks[BATCH_SIZE];
+  struct semaphore done;
+  struct bench b;
+  int i, j;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  bench_start (&b);
+  alloc_pairs (PAIR_CNT, 64);
+  bench_report (&b, "malloc/free pairs", PAIR_CNT);
+
+  bench_start (&b);
+  for (i = 0; i < BATCH_CNT; i++)
+    {
+      for (j = 0; j < BATCH_SIZE; j++)
+        {
+          blocks[j] = malloc (16 << (j % 6));
+          if (blocks[j] == NULL)
+            fail ("malloc failed");
+        }
+      for (j = 0; j < BATCH_SIZE; j++)
+        free (blocks[j]);
+    }
+  bench_report (&b, "batched mallocs", BATCH_CNT * BATCH_SIZE);
+
+  /* Stay above the threads so that we can start them all before
+     any of them runs. */
+  sema_init (&done, 0);
+  thread_set_priority (PRI_DEFAULT + 1);
+  bench_start (&b);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "malloc %d", i);
+      thread_create (name, PRI_DEFAULT, pairs_thread, &done);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  bench_report (&b, "concurrent malloc/free pairs", THREAD_CNT * PAIR_CNT);
+  thread_set_priority (PRI_DEFAULT);
+}
+
+/* Allocates and frees a SIZE-byte block CNT times. */
+static void
+alloc_pairs (int cnt, size_t size)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      char *p = malloc (size);
+      if (p == NULL)
+        fail ("malloc failed");
+      p[0] = i;
+      free (p);
+    }
+}
+
+static void
+pairs_thread (void *done_)
+{
+  struct semaphore *done = done_;
+
+  alloc_pairs (PAIR_CNT, 64);
+  sema_up (done);
+}
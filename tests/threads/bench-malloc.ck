@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench ("malloc/free pairs", "batched mallocs",
+	     "concurrent malloc/free pairs");
@@ -0,0 +1,126 @@
+/* Measures how CPU-bound and I/O-bound threads share the CPU.
+   For DURATION ticks, CPU_CNT threads spin while IO_CNT threads
+   of the same priority repeatedly sleep for one tick, standing
+   in for threads that wait on I/O.  Reports the work each class
+   got done and how evenly it was spread within the class. */
+
+#include <stdio.h>
+#include "tests/threads/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CPU_CNT 4
+#define IO_CNT 4
+#define DURATION (5 * TIMER_FREQ)
+
+struct worker
+  {
+    int64_t start;              /* When to start counting. */
+    struct semaphore *done;     /* Upped when finished. */
+    long long ops;              /* Loop iterations or wakeups. */
+    int ticks;                  /* Ticks seen running, for CPU threads. */
+  };
+
+static thread_func cpu_thread;
+static thread_func io_thread;
+
+void
+test_bench_mixed (void)
+{
+  struct worker workers[CPU_CNT + IO_CNT];
+  struct semaphore done;
+  struct bench b;
+  long long cpu_ops = 0, io_ops = 0;
+  long long io_min = -1, io_max = 0;
+  int cpu_min = -1, cpu_max = 0;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  /* Stay above the workers so that we can start them all before
+     any of them runs. */
+  thread_set_priority (PRI_DEFAULT + 1);
+  bench_start (&b);
+  for (i = 0; i < CPU_CNT + IO_CNT; i++)
+    {
+      struct worker *w = &workers[i];
+      char name[16];
+
+      w->start = b.start_ticks;
+      w->done = &done;
+      w->ops = 0;
+      w->ticks = 0;
+      if (i < CPU_CNT)
+        {
+          snprintf (name, sizeof name, "cpu %d", i);
+          thread_create (name, PRI_DEFAULT, cpu_thread, w);
+        }
+      else
+        {
+          snprintf (name, sizeof name, "io %d", i - CPU_CNT);
+          thread_create (name, PRI_DEFAULT, io_thread, w);
+        }
+    }
+  for (i = 0; i < CPU_CNT + IO_CNT; i++)
+    sema_down (&done);
+  thread_set_priority (PRI_DEFAULT);
+
+  for (i = 0; i < CPU_CNT; i++)
+    {
+      struct worker *w = &workers[i];
+      cpu_ops += w->ops;
+      if (cpu_min < 0 || w->ticks < cpu_min)
+        cpu_min = w->ticks;
+      if (w->ticks > cpu_max)
+        cpu_max = w->ticks;
+    }
+  for (i = CPU_CNT; i < CPU_CNT + IO_CNT; i++)
+    {
+      struct worker *w = &workers[i];
+      io_ops += w->ops;
+      if (io_min < 0 || w->ops < io_min)
+        io_min = w->ops;
+      if (w->ops > io_max)
+        io_max = w->ops;
+    }
+  bench_report (&b, "CPU-bound iterations", cpu_ops);
+  bench_report (&b, "I/O-bound wakeups", io_ops);
+  msg ("CPU-bound threads ran %d to %d ticks each.", cpu_min, cpu_max);
+  msg ("I/O-bound threads woke %lld to %lld times each.", io_min, io_max);
+}
+
+static void
+cpu_thread (void *w_)
+{
+  struct worker *w = w_;
+  int64_t last_time = 0;
+
+  while (timer_elapsed (w->start) < DURATION)
+    {
+      int64_t cur_time = timer_ticks ();
+      if (cur_time != last_time)
+        w->ticks++;
+      last_time = cur_time;
+      w->ops++;
+    }
+  sema_up (w->done);
+}
+
+static void
+io_thread (void *w_)
+{
+  struct worker *w = w_;
+
+  while (timer_elapsed (w->start) < DURATION)
+    {
+      timer_sleep (1);
+      w->ops++;
+    }
+  sema_up (w->done);
+}
@@ -0,0 +1,54 @@
+/* Measures context switch cost: the main thread and a second
+   thread of the same priority hand control back and forth
+   through a pair of semaphores.  Each round trip is two context
+   switches. */
+
+#include <stdio.h>
+#include "tests/threads/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_TRIPS 20000
+
+struct pingpong
+  {
+    struct semaphore ping;      /* Upped by the main thread. */
+    struct semaphore pong;      /* Upped by the "pong" thread. */
+  };
+
+static thread_func pong_thread;
+
+void
+test_bench_pingpong (void)
+{
+  struct pingpong pp;
+  struct bench b;
+  int i;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  thread_create ("pong", PRI_DEFAULT, pong_thread, &pp);
+
+  bench_start (&b);
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_up (&pp.ping);
+      sema_down (&pp.pong);
+    }
+  bench_report (&b, "semaphore round trips", ROUND_TRIPS);
+}
+
+static void
+pong_thread (void *pp_)
+{
+  struct pingpong *pp = pp_;
+  int i;
+
+  for (i = 0; i < ROUND_TRIPS; i++)
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
@@ -0,0 +1,63 @@
+/* Measures timer_sleep() under a storm of sleepers.
+   SLEEPER_CNT threads each sleep SLEEP_CNT times for between 1
+   and 7 ticks, so that hundreds of threads wake up on every
+   tick.
+
+   Each sleeper needs a page for its thread, so this needs more
+   memory than the default, e.g. "pintos -m 16". */
+
+#include <stdio.h>
+#include "tests/threads/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 1000
+#define SLEEP_CNT 5
+
+static thread_func sleeper_thread;
+
+/* Upped by each finished sleeper. */
+static struct semaphore done;
+
+void
+test_bench_sleepers (void)
+{
+  struct bench b;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  /* Stay above the sleepers so that we can start them all before
+     any of them runs. */
+  thread_set_priority (PRI_DEFAULT + 1);
+  bench_start (&b);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper_thread,
+                         (void *) i) == TID_ERROR)
+        fail ("out of memory after %d sleepers (try \"pintos -m 16\")", i);
+    }
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (&done);
+  bench_report (&b, "sleeper wakeups", (long long) SLEEPER_CNT * SLEEP_CNT);
+  thread_set_priority (PRI_DEFAULT);
+}
+
+static void
+sleeper_thread (void *aux)
+{
+  int id = (int) aux;
+  int i;
+
+  for (i = 0; i < SLEEP_CNT; i++)
+    timer_sleep (1 + (id + i) % 7);
+  sema_up (&done);
+}
@@ -0,0 +1,38 @@
+#include "tests/threads/bench.h"
+#include <debug.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "devices/timer.h"
+
+/* Starts timing benchmark B. */
+void
+bench_start (struct bench *b)
+{
+  /* Start on a tick boundary, so that the tick count does not
+     depend on where in a tick we happened to start. */
+  int64_t start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  b->start_ticks = timer_ticks ();
+  b->start_cycles = cpu_cycles ();
+}
+
+/* Reports OPS operations done for NAME since bench_start(B). */
+void
+bench_report (const struct bench *b, const char *name, long long ops)
+{
+  uint64_t cycles = cpu_cycles () - b->start_cycles;
+  int64_t ticks = timer_elapsed (b->start_ticks);
+
+  ASSERT (ops > 0);
+  if (ticks > 0)
+    {
+      long long milli = ops * 1000 / ticks;
+      msg ("%s: %lld ops in %lld ticks, %lld.%03lld ops/tick, "
+           "%llu cycles/op", name, ops, ticks, milli / 1000, milli % 1000,
+           cycles / ops);
+    }
+  else
+    msg ("%s: %lld ops in 0 ticks, %llu cycles/op", name, ops, cycles / ops);
+}
@@ -0,0 +1,27 @@
+#ifndef TESTS_THREADS_BENCH_H
+#define TESTS_THREADS_BENCH_H
+
+#include <stdint.h>
+
+/* Harness for the bench-* tests.
+
+   A benchmark calls bench_start(), does its work, and then calls
+   bench_report() for each result, giving the number of
+   operations done since bench_start().  Each result is printed
+   on one line, for tracking across runs:
+
+     (bench-foo) NAME: OPS ops in TICKS ticks, OPS/TICK ops/tick,
+     CYCLES cycles/op
+
+   The bench-* tests check only that every result was reported,
+   not how fast they were. */
+struct bench
+  {
+    int64_t start_ticks;        /* timer_ticks() at start. */
+    uint64_t start_cycles;      /* Time-stamp counter at start. */
+  };
+
+void bench_start (struct bench *);
+void bench_report (const struct bench *, const char *name, long long ops);
+
+#endif /* tests/threads/bench.h */
@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+
+# Checks that a bench-* test ran to completion and reported a
+# result for each of NAMES.  The numbers themselves vary from run
+# to run and are not checked.
+sub check_bench {
+    my (@names) = @_;
+    our ($test);
+
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    my (%reported);
+    foreach (@output) {
+	my ($name) = /^\(\S+\) (.+): \d+ ops in \d+ ticks/ or next;
+	$reported{$name} = 1;
+    }
+    foreach my $name (@names) {
+	fail "No result reported for \"$name\".\n" if !$reported{$name};
+    }
+    pass;
+}
+
+1;
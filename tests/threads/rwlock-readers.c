@@ -0,0 +1,125 @@
+/* Checks that a reader-writer lock admits its readers
+   concurrently and that it prefers writers.
+
+   First, READER_CNT threads each hold the lock for reading
+   while sleeping for SLEEP_TICKS.  If readers are admitted
+   together, all of them hold the lock at once and the whole
+   run takes about SLEEP_TICKS, not READER_CNT * SLEEP_TICKS as
+   it would with an exclusive lock.
+
+   Then the main thread holds the lock for reading while a
+   writer and, after it, a higher-priority reader arrive.  The
+   writer must get the lock before the late reader, and it must
+   run with the late reader's priority while it holds the lock. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define READER_CNT 8
+#define SLEEP_TICKS 10
+
+struct reader_info
+  {
+    struct rwlock rw;           /* Lock under test. */
+    struct semaphore done;      /* Upped by each finished reader. */
+    int active;                 /* Readers holding RW now. */
+    int max_active;             /* Most readers that held RW at once. */
+  };
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+static thread_func late_reader_thread;
+
+void
+test_rwlock_readers (void)
+{
+  struct reader_info info;
+  int64_t start_time, elapsed;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&info.rw);
+  sema_init (&info.done, 0);
+  info.active = info.max_active = 0;
+
+  start_time = timer_ticks ();
+  for (i = 0; i < READER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT + 1, reader_thread, &info);
+    }
+  for (i = 0; i < READER_CNT; i++)
+    sema_down (&info.done);
+  elapsed = timer_elapsed (start_time);
+
+  msg ("%d of %d readers held the lock at once.",
+       info.max_active, READER_CNT);
+  if (elapsed >= (int64_t) READER_CNT * SLEEP_TICKS)
+    fail ("readers took %lld ticks, no better than exclusive access",
+          elapsed);
+  msg ("Readers finished faster than with exclusive access.");
+
+  rwlock_acquire_read (&info.rw);
+  msg ("Main thread acquired lock for reading.");
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, &info);
+  thread_create ("late reader", PRI_DEFAULT + 2, late_reader_thread, &info);
+  msg ("Main thread releasing lock.");
+  rwlock_release_read (&info.rw);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread (void *info_)
+{
+  struct reader_info *info = info_;
+  enum intr_level old_level;
+
+  rwlock_acquire_read (&info->rw);
+
+  old_level = intr_disable ();
+  if (++info->active > info->max_active)
+    info->max_active = info->active;
+  intr_set_level (old_level);
+
+  timer_sleep (SLEEP_TICKS);
+
+  old_level = intr_disable ();
+  info->active--;
+  intr_set_level (old_level);
+
+  rwlock_release_read (&info->rw);
+  sema_up (&info->done);
+}
+
+static void
+writer_thread (void *info_)
+{
+  struct reader_info *info = info_;
+
+  rwlock_acquire_write (&info->rw);
+  msg ("Writer acquired lock with priority %d.", thread_get_priority ());
+  rwlock_release_write (&info->rw);
+  msg ("Writer finished.");
+}
+
+static void
+late_reader_thread (void *info_)
+{
+  struct reader_info *info = info_;
+
+  rwlock_acquire_read (&info->rw);
+  msg ("Late reader acquired lock.");
+  rwlock_release_read (&info->rw);
+  msg ("Late reader finished.");
+}
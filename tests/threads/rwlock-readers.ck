@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-readers) begin
+(rwlock-readers) 8 of 8 readers held the lock at once.
+(rwlock-readers) Readers finished faster than with exclusive access.
+(rwlock-readers) Main thread acquired lock for reading.
+(rwlock-readers) Main thread releasing lock.
+(rwlock-readers) Writer acquired lock with priority 33.
+(rwlock-readers) Late reader acquired lock.
+(rwlock-readers) Late reader finished.
+(rwlock-readers) Writer finished.
+(rwlock-readers) Main thread finished.
+(rwlock-readers) end
+EOF
+pass;
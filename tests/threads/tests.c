@@ -30,6 +30,15 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"rwlock-readers", test_rwlock_readers},
+    {"stride-fair", test_stride_fair},
+    {"workqueue-prio", test_workqueue_prio},
+    {"bench-pingpong", test_bench_pingpong},
+    {"bench-lock-convoy", test_bench_lock_convoy},
+    {"bench-sleepers", test_bench_sleepers},
+    {"bench-donate-chain", test_bench_donate_chain},
+    {"bench-mixed", test_bench_mixed},
+    {"bench-malloc", test_bench_malloc},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
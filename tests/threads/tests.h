@@ -24,6 +24,15 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_rwlock_readers;
+extern test_func test_stride_fair;
+extern test_func test_workqueue_prio;
+extern test_func test_bench_pingpong;
+extern test_func test_bench_lock_convoy;
+extern test_func test_bench_sleepers;
+extern test_func test_bench_donate_chain;
+extern test_func test_bench_mixed;
+extern test_func test_bench_malloc;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
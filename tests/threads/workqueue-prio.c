@@ -0,0 +1,53 @@
+/* Queues work at each work queue priority and checks that each
+   item runs on a worker thread of the right priority, in order:
+   high-priority work right away, normal work once the main
+   thread blocks, and low-priority work last.  Also checks that an
+   item that is already pending is not queued twice. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+static struct semaphore done;
+
+static void
+run_work (void *name)
+{
+  msg ("%s work ran at priority %d.", (const char *) name,
+       thread_get_priority ());
+  sema_up (&done);
+}
+
+void
+test_workqueue_prio (void)
+{
+  struct work low, normal, high;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&done, 0);
+  work_init (&low, run_work, "Low");
+  work_init (&normal, run_work, "Normal");
+  work_init (&high, run_work, "High");
+
+  msg ("Queueing low work: %s.",
+       work_queue (&low, WORK_LOW) ? "queued" : "not queued");
+  msg ("Queueing low work again: %s.",
+       work_queue (&low, WORK_LOW) ? "queued" : "not queued");
+  msg ("Queueing normal work: %s.",
+       work_queue (&normal, WORK_NORMAL) ? "queued" : "not queued");
+  msg ("Queueing high work.");
+  work_queue (&high, WORK_HIGH);
+  msg ("Waiting for work.");
+  for (i = 0; i < 3; i++)
+    sema_down (&done);
+  msg ("All work done.");
+}
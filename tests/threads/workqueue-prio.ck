@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue-prio) begin
+(workqueue-prio) Queueing low work: queued.
+(workqueue-prio) Queueing low work again: not queued.
+(workqueue-prio) Queueing normal work: queued.
+(workqueue-prio) Queueing high work.
+(workqueue-prio) High work ran at priority 63.
+(workqueue-prio) Waiting for work.
+(workqueue-prio) Normal work ran at priority 31.
+(workqueue-prio) Low work ran at priority 0.
+(workqueue-prio) All work done.
+(workqueue-prio) end
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Measures how fast the kernel can start a process and reap it,
+   by executing and waiting for child-simple repeatedly. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Timer ticks per second; see devices/timer.h. */
+#define TIMER_FREQ 100
+
+#define ROUND_TRIPS 50
+
+void
+test_main (void) 
+{
+  struct thread_stats start, end;
+  long long ticks;
+  int i;
+
+  thread_stats (&start);
+  for (i = 0; i < ROUND_TRIPS; i++)
+    if (wait (exec ("child-simple")) != 81)
+      fail ("child-simple did not exit with status 81");
+  thread_stats (&end);
+
+  ticks = end.now - start.now;
+  msg ("%d exec+wait round trips in %lld ticks (%lld per second)",
+       ROUND_TRIPS, ticks, ticks > 0 ? ROUND_TRIPS * TIMER_FREQ / ticks : 0);
+}
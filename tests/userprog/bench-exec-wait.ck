@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my ($exits) = scalar (grep (/^child-simple: exit\(81\)$/, @output));
+fail "expected 50 child exits, got $exits\n" if $exits != 50;
+fail "missing round trip rate\n"
+  if !grep (/^\(bench-exec-wait\) 50 exec\+wait round trips in \d+ ticks/,
+	    @output);
+fail "missing exit\n" if !grep ($_ eq 'bench-exec-wait: exit(0)', @output);
+pass;
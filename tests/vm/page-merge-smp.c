@@ -0,0 +1,12 @@
+/* Runs page-merge-stk's parallel merge on a machine with four
+   CPUs, so that the children sort on several CPUs at once and
+   their page faults and evictions race with each other's. */
+
+#include "tests/main.h"
+#include "tests/vm/parallel-merge.h"
+
+void
+test_main (void) 
+{
+  parallel_merge ("child-qsort", 72);
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-merge-smp) begin
+(page-merge-smp) init
+(page-merge-smp) sort chunk 0
+(page-merge-smp) sort chunk 1
+(page-merge-smp) sort chunk 2
+(page-merge-smp) sort chunk 3
+(page-merge-smp) sort chunk 4
+(page-merge-smp) sort chunk 5
+(page-merge-smp) sort chunk 6
+(page-merge-smp) sort chunk 7
+(page-merge-smp) wait for child 0
+(page-merge-smp) wait for child 1
+(page-merge-smp) wait for child 2
+(page-merge-smp) wait for child 3
+(page-merge-smp) wait for child 4
+(page-merge-smp) wait for child 5
+(page-merge-smp) wait for child 6
+(page-merge-smp) wait for child 7
+(page-merge-smp) merge
+(page-merge-smp) verify
+(page-merge-smp) success, buf_idx=1,048,576
+(page-merge-smp) end
+EOF
+pass;
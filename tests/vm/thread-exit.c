@@ -0,0 +1,24 @@
+/* Checks that exit() in a user thread ends the whole process,
+   including the initial thread, which is asleep in futex_wait()
+   on a word that nobody wakes. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int never;
+
+static void
+exit_thread (void *aux UNUSED)
+{
+  msg ("thread calling exit(57)");
+  exit (57);
+}
+
+void
+test_main (void)
+{
+  CHECK (thread_create (exit_thread, NULL) != TID_ERROR, "create thread");
+  for (;;)
+    futex_wait (&never, 0);
+}
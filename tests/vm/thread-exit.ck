@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-exit) begin
+(thread-exit) create thread
+(thread-exit) thread calling exit(57)
+thread-exit: exit(57)
+EOF
+pass;
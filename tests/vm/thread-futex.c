@@ -0,0 +1,72 @@
+/* Runs several user threads that increment a shared counter
+   under a mutex built on futex_wait() and futex_wake(), then
+   joins them and checks that no increment was lost. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITERATIONS 1000
+
+/* Mutex states. */
+#define UNLOCKED 0
+#define LOCKED 1                /* Locked, nobody waiting. */
+#define CONTENDED 2             /* Locked, maybe with waiters. */
+
+static int mutex;
+static volatile int counter;
+
+static void
+mutex_lock (int *m)
+{
+  int c = __sync_val_compare_and_swap (m, UNLOCKED, LOCKED);
+  while (c != UNLOCKED)
+    {
+      if (c == CONTENDED
+          || __sync_val_compare_and_swap (m, LOCKED, CONTENDED) != UNLOCKED)
+        futex_wait (m, CONTENDED);
+      c = __sync_val_compare_and_swap (m, UNLOCKED, CONTENDED);
+    }
+}
+
+static void
+mutex_unlock (int *m)
+{
+  if (__sync_fetch_and_sub (m, 1) != LOCKED)
+    {
+      *m = UNLOCKED;
+      futex_wake (m, 1);
+    }
+}
+
+static void
+increment (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      mutex_lock (&mutex);
+      counter = counter + 1;
+      mutex_unlock (&mutex);
+    }
+}
+
+void
+test_main (void)
+{
+  tid_t threads[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((threads[i] = thread_create (increment, NULL)) != TID_ERROR,
+           "create thread %d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (thread_join (threads[i]) == 0, "join thread %d", i);
+  CHECK (thread_join (threads[0]) == -1, "join thread 0 again");
+
+  if (counter != THREAD_CNT * ITERATIONS)
+    fail ("counter is %d, expected %d", counter, THREAD_CNT * ITERATIONS);
+  msg ("counter is %d", counter);
+}
@@ -0,0 +1,151 @@
+#include "threads/arena.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/shrinker.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Scratch arenas.
+
+   Some kernel paths need a little memory only until they return,
+   such as a copy of a command line.  Instead of going to malloc()
+   or the page allocator each time, a thread can take it from its
+   arena, a page that it holds for the purpose, by bumping a
+   pointer.  arena_mark() records the current position, and
+   arena_release() goes back to it, freeing everything allocated
+   since at once, so that uses nest like a stack.
+
+   A thread gets a page on its first arena_alloc() and gives it
+   up when it releases back to an empty arena.  Given-up pages
+   are kept on a short list of spares for the next thread, so in
+   steady state the page allocator is not involved at all.  A
+   shrinker frees the spares under memory pressure. */
+
+/* Spare pages, protected by disabling interrupts. */
+#define SPARE_MAX 8
+static void *spares[SPARE_MAX];
+static size_t spare_cnt;
+
+/* Frees spare pages under memory pressure. */
+static struct shrinker shrinker;
+
+static shrink_func shrink_spares;
+static void put_page (void *);
+
+/* Initializes scratch arenas. */
+void
+arena_init (void) 
+{
+  shrinker_register (&shrinker, "arena spares", SHRINK_SPARE, shrink_spares);
+}
+
+/* Returns the running thread's current arena position, for a
+   later call to arena_release(). */
+size_t
+arena_mark (void) 
+{
+  return thread_current ()->arena_used;
+}
+
+/* Allocates SIZE bytes from the running thread's arena and
+   returns them, aligned for any type.  Returns a null pointer if
+   they do not fit in what is left of the arena or no page is
+   available.  The memory is freed by arena_release() to a mark
+   taken before the call. */
+void *
+arena_alloc (size_t size) 
+{
+  struct thread *t = thread_current ();
+  void *p;
+
+  size = ROUND_UP (size, sizeof (long long));
+  if (size > PGSIZE - t->arena_used)
+    return NULL;
+
+  if (t->arena == NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (spare_cnt > 0)
+        t->arena = spares[--spare_cnt];
+      intr_set_level (old_level);
+
+      if (t->arena == NULL)
+        {
+          t->arena = palloc_get_page (0);
+          if (t->arena == NULL)
+            return NULL;
+        }
+    }
+
+  p = t->arena + t->arena_used;
+  t->arena_used += size;
+  return p;
+}
+
+/* Frees everything allocated from the running thread's arena
+   since MARK was returned by arena_mark(). */
+void
+arena_release (size_t mark) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (mark <= t->arena_used);
+  t->arena_used = mark;
+  if (mark == 0 && t->arena != NULL)
+    {
+      put_page (t->arena);
+      t->arena = NULL;
+    }
+}
+
+/* Releases dying thread T's arena, in case T exits with some of
+   it still allocated. */
+void
+arena_thread_exit (struct thread *t) 
+{
+  if (t->arena != NULL)
+    {
+      put_page (t->arena);
+      t->arena = NULL;
+      t->arena_used = 0;
+    }
+}
+
+/* Keeps arena page PAGE as a spare, or frees it if there are
+   enough spares already. */
+static void
+put_page (void *page) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (spare_cnt < SPARE_MAX)
+    {
+      spares[spare_cnt++] = page;
+      page = NULL;
+    }
+  intr_set_level (old_level);
+
+  palloc_free_page (page);
+}
+
+/* Frees spare pages until PAGE_CNT have been freed, and returns
+   the number freed. */
+static size_t
+shrink_spares (size_t page_cnt) 
+{
+  size_t freed;
+
+  for (freed = 0; freed < page_cnt; freed++)
+    {
+      enum intr_level old_level = intr_disable ();
+      void *page = spare_cnt > 0 ? spares[--spare_cnt] : NULL;
+      intr_set_level (old_level);
+
+      if (page == NULL)
+        break;
+      palloc_free_page (page);
+    }
+  return freed;
+}
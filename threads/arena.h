@@ -0,0 +1,15 @@
+#ifndef THREADS_ARENA_H
+#define THREADS_ARENA_H
+
+#include <stddef.h>
+
+struct thread;
+
+/* Per-thread scratch memory.  See arena.c. */
+void arena_init (void);
+size_t arena_mark (void);
+void *arena_alloc (size_t);
+void arena_release (size_t mark);
+void arena_thread_exit (struct thread *);
+
+#endif /* threads/arena.h */
@@ -0,0 +1,495 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/flags.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/kstack.h"
+#include "threads/lapic.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/trampoline.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/tss.h"
+#endif
+
+/* Per-CPU state, indexed by CPU number.  cpus[0] is always the
+   bootstrap processor. */
+struct cpu cpus[CPU_MAX];
+
+/* Number of CPUs found.  Only those marked online actually run
+   threads. */
+int cpu_cnt;
+
+/* Physical address of the local APICs, from the MP table. */
+static uintptr_t lapic_addr;
+
+/* The big kernel lock.
+
+   The kernel was written for one CPU, and keeps other code out
+   of its critical sections by turning interrupts off.  That
+   stops interrupt handlers and thread switches on the same CPU,
+   but not another CPU.  So only one CPU at a time runs kernel
+   code: the one holding this lock.  A CPU takes it in
+   intr_handler(), on entry from user mode or from the "hlt" in
+   its idle loop, and gives it up in intr_exit, on return to user
+   mode, or just before that "hlt".  User programs and idle loops
+   on different CPUs thus run in parallel, and the kernel runs
+   as if on one CPU, with intr_disable() as good as ever.
+
+   The lock belongs to a CPU, not a thread: a thread switch
+   leaves it held, so the scheduler always runs with it.  A CPU
+   that stays in the kernel running kernel threads passes it on
+   at each timer tick if another CPU is waiting, in
+   big_lock_yield(), where interrupts were on and so anything
+   else could have run anyway.
+
+   It is a ticket lock, so that waiting CPUs get it in turn.
+   While they wait, they answer TLB shootdowns from the holder,
+   which would otherwise wait for them forever. */
+static volatile uint32_t big_lock_next;    /* Next ticket to hand out. */
+static volatile uint32_t big_lock_serving; /* Ticket that holds the lock. */
+static struct cpu *volatile big_lock_holder; /* CPU holding it. */
+
+/* CPUs that still have to flush their TLBs for cpu_flush_tlbs(),
+   one bit per CPU.  Only the big kernel lock's holder sets bits;
+   each CPU clears its own. */
+static volatile uint32_t flush_pending;
+
+static void init_cpu (struct cpu *, int id);
+static bool start_ap (struct cpu *, uint32_t *pd);
+static uint32_t *trampoline_word (char *label);
+
+/* Initializes the bootstrap processor's per-CPU state, and gives
+   it the big kernel lock.  Called by thread_init() before any
+   thread is scheduled. */
+void
+cpu_init (void)
+{
+  init_cpu (&cpus[0], 0);
+  cpus[0].bsp = true;
+  cpu_cnt = 1;
+
+  big_lock_next = 1;
+  big_lock_serving = 0;
+  big_lock_holder = &cpus[0];
+}
+
+/* Returns the CPU that the running thread is on.  Must be called
+   with interrupts off, or the thread could migrate before the
+   caller uses the result. */
+struct cpu *
+cpu_current (void)
+{
+  uint32_t *esp;
+
+  /* Same as running_thread() in thread.c. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return ((struct thread *) kstack_owner (esp))->cpu;
+}
+
+static void
+init_cpu (struct cpu *c, int id)
+{
+  memset (c, 0, sizeof *c);
+  c->id = id;
+  spinlock_init (&c->ready_lock);
+  list_init (&c->ready_list);
+}
+
+/* Acquires the big kernel lock for the running CPU, spinning
+   until it is free.  Interrupts must be off. */
+void
+big_lock_acquire (void)
+{
+  uint32_t ticket = 1;
+  uint32_t self;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!big_lock_held ());
+
+  self = 1u << cpu_current ()->id;
+  asm volatile ("lock xaddl %0, %1"
+                : "+r" (ticket), "+m" (big_lock_next) : : "memory");
+  while (big_lock_serving != ticket)
+    {
+      if (flush_pending & self)
+        cpu_flush_ack ();
+      asm volatile ("pause");
+    }
+  big_lock_holder = cpu_current ();
+}
+
+/* Releases the big kernel lock, which the running CPU must hold.
+   Interrupts must be off. */
+void
+big_lock_release (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (big_lock_held ());
+
+  big_lock_holder = NULL;
+  barrier ();
+  big_lock_serving++;
+}
+
+/* Lets another CPU have the big kernel lock, if one is waiting,
+   and then takes it back.  Interrupts must be off. */
+void
+big_lock_yield (void)
+{
+  if (big_lock_next - big_lock_serving > 1)
+    {
+      big_lock_release ();
+      big_lock_acquire ();
+    }
+}
+
+/* Returns true if the running CPU holds the big kernel lock. */
+bool
+big_lock_held (void)
+{
+  return big_lock_holder == cpu_current ();
+}
+
+/* Acquires the big kernel lock if the running CPU does not hold
+   it yet, leaving the interrupt level as it was.  Called by
+   intr_handler() on entry, possibly through a trap gate with
+   interrupts on: they stay off until the lock is held, because an
+   interrupt in between would take the lock first. */
+void
+big_lock_enter (void)
+{
+  uint32_t flags;
+
+  asm volatile ("pushfl; popl %0; cli" : "=g" (flags) : : "memory");
+  if (!big_lock_held ())
+    big_lock_acquire ();
+  if (flags & FLAG_IF)
+    asm volatile ("sti" : : : "memory");
+}
+
+/* Releases the big kernel lock if the running CPU holds it.
+   Called by intr_exit, with interrupts off, just before it
+   returns to user mode. */
+void
+big_lock_leave (void)
+{
+  if (big_lock_held ())
+    big_lock_release ();
+}
+
+/* Makes every other online CPU whose active page directory is PD
+   flush its TLB, or every other online CPU if PD is a null
+   pointer, and waits until they have.  The running CPU's own TLB
+   is up to the caller.  The caller must hold the big kernel
+   lock. */
+void
+cpu_flush_tlbs (uint32_t *pd)
+{
+  enum intr_level old_level;
+  struct cpu *self;
+  uint32_t mask = 0;
+  int i;
+
+  if (cpu_cnt == 1)
+    return;
+
+  old_level = intr_disable ();
+  ASSERT (big_lock_held ());
+  self = cpu_current ();
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != self && cpus[i].online
+        && (pd == NULL || cpus[i].pagedir == pd))
+      mask |= 1u << i;
+
+  if (mask != 0)
+    {
+      asm volatile ("lock orl %1, %0"
+                    : "+m" (flush_pending) : "r" (mask) : "memory");
+      for (i = 0; i < cpu_cnt; i++)
+        if (mask & (1u << i))
+          lapic_send_ipi (cpus[i].apic_id, LAPIC_VEC_FLUSH);
+      while (flush_pending & mask)
+        asm volatile ("pause");
+    }
+  intr_set_level (old_level);
+}
+
+/* Flushes the running CPU's TLB for cpu_flush_tlbs().  The
+   request is marked done first, so that one made meanwhile is
+   not lost; the caller touches nothing the flush is for before
+   it returns. */
+void
+cpu_flush_ack (void)
+{
+  uint32_t cr3;
+
+  asm volatile ("lock andl %1, %0"
+                : "+m" (flush_pending) : "r" (~(1u << cpu_current ()->id))
+                : "memory");
+
+  /* Reloading CR3 flushes the TLB.  See [IA32-v3a] 3.12
+     "Translation Lookaside Buffers (TLBs)". */
+  asm volatile ("movl %%cr3, %0; movl %0, %%cr3" : "=r" (cr3) : : "memory");
+}
+
+/* MP floating pointer structure.
+   See [MP] 4.1 "MP Floating Pointer Structure". */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];
+  }
+__attribute__ ((packed));
+
+/* MP configuration table header.
+   See [MP] 4.2 "MP Configuration Table Header". */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of base table. */
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;         /* Number of entries that follow. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  }
+__attribute__ ((packed));
+
+/* MP configuration table processor entry.
+   See [MP] 4.3.1 "Processor Entries". */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;
+    uint8_t flags;              /* MP_CPU_* flags. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  }
+__attribute__ ((packed));
+
+#define MP_PROCESSOR 0          /* Entry type of a processor. */
+#define MP_CPU_ENABLED 0x01     /* Processor is usable. */
+#define MP_CPU_BSP 0x02         /* Processor is the BSP. */
+
+/* Returns true if the SIZE bytes at P sum to zero. */
+static bool
+checksum_ok (const void *p, size_t size)
+{
+  const uint8_t *bytes = p;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *bytes++;
+  return sum == 0;
+}
+
+/* Searches SIZE bytes of physical memory at PHYS for the MP
+   floating pointer structure, which is aligned on a 16-byte
+   boundary.  Returns it if found, otherwise a null pointer. */
+static struct mp_float *
+search_mp_float (uintptr_t phys, size_t size)
+{
+  uint8_t *p = ptov (phys);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_float)))
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Finds the MP floating pointer structure in the places [MP]
+   4.0 says to look: the first kB of the extended BIOS data
+   area, the last kB of base memory, and the BIOS ROM. */
+static struct mp_float *
+find_mp_float (void)
+{
+  uint8_t *bda = ptov (0x400);
+  uintptr_t ebda = *(uint16_t *) (bda + 0x0e) << 4;
+  uintptr_t base_kb = *(uint16_t *) (bda + 0x13);
+  struct mp_float *mp = NULL;
+
+  if (ebda != 0)
+    mp = search_mp_float (ebda, 1024);
+  if (mp == NULL && base_kb != 0)
+    mp = search_mp_float (base_kb * 1024 - 1024, 1024);
+  if (mp == NULL)
+    mp = search_mp_float (0xf0000, 0x10000);
+  return mp;
+}
+
+/* Finds the processors listed in the MP configuration table and
+   records them in cpus[].  If there is no usable table, assumes
+   a uniprocessor.  Only the bootstrap processor is running
+   afterward: cpu_start_aps() starts the others. */
+void
+cpu_detect (void)
+{
+  struct mp_float *mp = find_mp_float ();
+  struct mp_config *config;
+  uint8_t *entry;
+  int i;
+
+  if (mp == NULL || mp->config == 0
+      || mp->config >= ram_pages * PGSIZE)
+    {
+      printf ("CPU: no MP configuration table, assuming 1 CPU\n");
+      return;
+    }
+  config = ptov (mp->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || !checksum_ok (config, config->length))
+    {
+      printf ("CPU: bad MP configuration table, assuming 1 CPU\n");
+      return;
+    }
+  lapic_addr = config->lapic_addr;
+
+  entry = (uint8_t *) (config + 1);
+  for (i = 0; i < config->entry_cnt; i++)
+    {
+      if (*entry == MP_PROCESSOR)
+        {
+          struct mp_processor *proc = (struct mp_processor *) entry;
+          if (!(proc->flags & MP_CPU_ENABLED))
+            ; /* Not usable. */
+          else if (proc->flags & MP_CPU_BSP)
+            cpus[0].apic_id = proc->apic_id;
+          else if (cpu_cnt < CPU_MAX)
+            {
+              init_cpu (&cpus[cpu_cnt], cpu_cnt);
+              cpus[cpu_cnt].apic_id = proc->apic_id;
+              cpu_cnt++;
+            }
+          entry += sizeof (struct mp_processor);
+        }
+      else
+        entry += 8;
+    }
+
+  printf ("CPU: %d processor%s found\n", cpu_cnt, cpu_cnt != 1 ? "s" : "");
+}
+
+/* Starts the application processors found by cpu_detect(), one
+   at a time.  Must be called with interrupts on, after
+   timer_calibrate(), and before any process page directory is
+   created, because lapic_init() adds to the base page
+   directory. */
+void
+cpu_start_aps (void)
+{
+  uint32_t *pd;
+  int online_cnt;
+  int i;
+
+  if (cpu_cnt == 1)
+    return;
+  lapic_init (lapic_addr);
+
+  /* The trampoline turns on paging while it is still running in
+     low memory, so its page directory maps the first 4 MB of
+     physical memory at virtual address 0 as well as at
+     PHYS_BASE. */
+  pd = palloc_get_page (PAL_ASSERT);
+  memcpy (pd, base_page_dir, PGSIZE);
+  pd[0] = base_page_dir[pd_no (ptov (0))];
+  memcpy (ptov (TRAMPOLINE_BASE), trampoline_start,
+          trampoline_end - trampoline_start);
+
+  online_cnt = 1;
+  for (i = 1; i < cpu_cnt; i++)
+    {
+      if (!start_ap (&cpus[i], pd))
+        {
+          printf ("CPU: processor %d did not start\n", i);
+          break;
+        }
+      online_cnt++;
+    }
+
+  /* A processor that did not answer in time could still start
+     later and use PD, so it is only freed if all of them did. */
+  if (online_cnt == cpu_cnt)
+    palloc_free_page (pd);
+  printf ("CPU: %d of %d processors online\n", online_cnt, cpu_cnt);
+}
+
+/* Sends application processor C into the trampoline, with page
+   directory PD and a new idle thread's stack, and waits up to a
+   second for it to come online.  Returns true if it did. */
+static bool
+start_ap (struct cpu *c, uint32_t *pd)
+{
+  struct thread *idle;
+  int i;
+
+  idle = thread_create_idle (c);
+  if (idle == NULL)
+    return false;
+#ifdef USERPROG
+  tss_create (c->id);
+#endif
+
+  *trampoline_word (tr_esp) = (uint32_t) kstack_top (idle);
+  *trampoline_word (tr_cr3) = vtop (pd);
+  lapic_start_ap (c->apic_id, TRAMPOLINE_BASE);
+
+  for (i = 0; i < TIMER_FREQ && !c->online; i++)
+    timer_sleep (1);
+  return c->online;
+}
+
+/* Returns the copy, at TRAMPOLINE_BASE, of the word at LABEL in
+   the trampoline. */
+static uint32_t *
+trampoline_word (char *label)
+{
+  return (uint32_t *) ((uint8_t *) ptov (TRAMPOLINE_BASE)
+                       + (label - trampoline_start));
+}
+
+/* Application processor entry point, called by the trampoline on
+   the stack of the processor's idle thread, with interrupts off.
+   Finishes setting up the processor, then becomes its idle
+   thread. */
+void
+cpu_ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+
+  /* Drop the trampoline's page directory. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)) : "memory");
+  c->pagedir = base_page_dir;
+
+#ifdef USERPROG
+  gdt_init_ap (c->id);
+#endif
+  intr_init_ap ();
+  lapic_init_ap ();
+  fpu_init_ap ();
+  lapic_timer_start ();
+
+  c->online = true;
+  big_lock_acquire ();
+  thread_start_ap ();
+}
@@ -0,0 +1,71 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <debug.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Maximum number of CPUs supported. */
+#define CPU_MAX 8
+
+/* Per-CPU state.
+
+   Each CPU always runs a different thread, so the running
+   thread, which is found from the stack pointer, identifies the
+   CPU as well: see cpu_current().  Members owned by thread.c
+   may only be touched by their own CPU with interrupts off,
+   except for ready_list, which other CPUs may steal from while
+   holding ready_lock, and idle, which they read to decide
+   whether to wake the CPU up. */
+struct cpu
+  {
+    int id;                     /* Index in cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    bool bsp;                   /* Bootstrap processor? */
+    volatile bool online;       /* Running the scheduler? */
+    uint32_t *pagedir;          /* Active page directory. */
+
+    /* Owned by thread.c. */
+    struct spinlock ready_lock; /* Protects ready_list. */
+    struct list ready_list;     /* Threads ready to run here. */
+    struct thread *idle_thread; /* This CPU's idle thread. */
+    volatile bool idle;         /* Halted in the idle thread? */
+    struct thread *fpu_owner;   /* Thread whose state is in the FPU. */
+    unsigned thread_ticks;      /* # of timer ticks since last yield. */
+    long long idle_ticks;       /* # of timer ticks spent idle. */
+    long long kernel_ticks;     /* # of timer ticks in kernel threads. */
+    long long user_ticks;       /* # of timer ticks in user programs. */
+    long long steal_cnt;        /* # of threads stolen from other CPUs. */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+void cpu_init (void);
+void cpu_detect (void);
+void cpu_start_aps (void);
+struct cpu *cpu_current (void);
+void cpu_ap_main (void) NO_RETURN;
+
+void big_lock_acquire (void);
+void big_lock_release (void);
+void big_lock_yield (void);
+bool big_lock_held (void);
+void big_lock_enter (void);
+void big_lock_leave (void);
+
+void cpu_flush_tlbs (uint32_t *pd);
+void cpu_flush_ack (void);
+
+/* Returns the current CPU's time-stamp counter. */
+static inline uint64_t
+cpu_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
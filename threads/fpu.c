@@ -0,0 +1,278 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Lazy FPU context switching.
+
+   The FPU, MMX and SSE registers are not saved on every context
+   switch.  Instead, the CPU's "task switched" flag, CR0.TS, is
+   set whenever a thread other than the one whose state is in
+   the FPU, the CPU's fpu_owner, starts running.  The first FPU
+   or SSE instruction that thread executes raises #NM (device
+   not available).  The handler saves the owner's state, loads
+   the new thread's state, and makes it the owner.  A thread that
+   never touches the FPU thus never pays for it, and one that is
+   the only FPU user on its CPU pays nothing after its first use.
+
+   The kernel itself is compiled with -msoft-float, so only user
+   programs use the FPU. */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Native FPU error reporting. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE/FXRSTOR. */
+#define CR4_OSXMMEXCPT 0x00000400 /* OS handles #XF. */
+
+/* CPUID function 1 EDX bits. */
+#define CPUID_FPU 0x00000001    /* x87 FPU on chip. */
+#define CPUID_FXSR 0x01000000   /* FXSAVE/FXRSTOR. */
+#define CPUID_SSE 0x02000000    /* SSE. */
+
+/* Size of a saved FPU state.  FXSAVE needs 512 bytes aligned on
+   a 16-byte boundary; FNSAVE needs only 108. */
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+/* Initial MXCSR: all SIMD exceptions masked. */
+#define MXCSR_DEFAULT 0x1f80
+
+static bool fpu_present;        /* Is there an FPU at all? */
+static bool use_fxsr;           /* Use FXSAVE rather than FNSAVE? */
+static bool sse_enabled;        /* SSE enabled in CR4? */
+
+/* Statistics. */
+static long long trap_cnt;      /* # of #NM traps. */
+static long long save_cnt;      /* # of states saved for another thread. */
+
+static intr_handler_func fpu_trap;
+static void enable (void);
+
+static inline uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+static inline void
+set_ts (void)
+{
+  write_cr0 (read_cr0 () | CR0_TS);
+}
+
+static inline void
+clear_ts (void)
+{
+  asm volatile ("clts");
+}
+
+/* Returns T's saved FPU state area, suitably aligned. */
+static void *
+state_area (struct thread *t)
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu_state, FPU_STATE_ALIGN);
+}
+
+/* Saves the FPU state into T's state area. */
+static void
+save_state (struct thread *t)
+{
+  void *area = state_area (t);
+
+  if (use_fxsr)
+    asm volatile ("fxsave (%0)" : : "r" (area) : "memory");
+  else
+    asm volatile ("fnsave (%0); fwait" : : "r" (area) : "memory");
+}
+
+/* Loads the FPU state from T's state area. */
+static void
+restore_state (struct thread *t)
+{
+  void *area = state_area (t);
+
+  if (use_fxsr)
+    asm volatile ("fxrstor (%0)" : : "r" (area) : "memory");
+  else
+    asm volatile ("frstor (%0)" : : "r" (area) : "memory");
+}
+
+/* Detects the FPU and SSE, enables them, and installs the #NM
+   handler that switches FPU state lazily. */
+void
+fpu_init (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  fpu_present = (edx & CPUID_FPU) != 0;
+  use_fxsr = (edx & CPUID_FXSR) != 0;
+  sse_enabled = use_fxsr && (edx & CPUID_SSE) != 0;
+  if (!fpu_present)
+    {
+      printf ("FPU: not present, floating point disabled\n");
+      return;
+    }
+
+  enable ();
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+  printf ("FPU: lazy switching with %s%s\n",
+          use_fxsr ? "FXSAVE" : "FNSAVE", sse_enabled ? ", SSE enabled" : "");
+}
+
+/* Enables the FPU and SSE on the running application processor,
+   the same way fpu_init() did on the bootstrap processor.  The
+   processors of one machine are assumed to be alike. */
+void
+fpu_init_ap (void)
+{
+  if (fpu_present)
+    enable ();
+}
+
+/* Called by schedule_tail() when T starts running.  Leaves the
+   FPU usable without a trap only if T's state is already in it. */
+void
+fpu_switch (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!fpu_present)
+    return;
+  if (t->cpu->fpu_owner == t)
+    clear_ts ();
+  else
+    set_ts ();
+}
+
+/* Releases dying thread T's FPU state. */
+void
+fpu_thread_exit (struct thread *t)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (t->cpu->fpu_owner == t)
+    {
+      t->cpu->fpu_owner = NULL;
+      set_ts ();
+    }
+  intr_set_level (old_level);
+
+  free (t->fpu_state);
+  t->fpu_state = NULL;
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void)
+{
+  if (fpu_present)
+    printf ("FPU: %lld traps, %lld states saved\n", trap_cnt, save_cnt);
+}
+
+/* Enables the FPU, and FXSAVE and SSE if present, on the
+   running CPU. */
+static void
+enable (void)
+{
+  uint32_t cr0;
+
+  if (use_fxsr)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_OSFXSR;
+      if (sse_enabled)
+        cr4 |= CR4_OSXMMEXCPT;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
+  /* The loader turned on emulation so that any FPU instruction
+     would trap.  Turn it off, and set TS: no thread owns the FPU
+     yet. */
+  cr0 = read_cr0 ();
+  cr0 &= ~CR0_EM;
+  cr0 |= CR0_MP | CR0_NE | CR0_TS;
+  write_cr0 (cr0);
+}
+
+/* #NM handler.  Gives the FPU to the current thread. */
+static void
+fpu_trap (struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+  bool fresh = false;
+
+#ifdef USERPROG
+  if (f->cs != SEL_UCSEG)
+#endif
+    {
+      intr_dump_frame (f);
+      PANIC ("Kernel bug - FPU used in kernel");
+    }
+
+  /* Allocate a save area on first use.  Do it with interrupts on,
+     since malloc() may sleep. */
+  if (t->fpu_state == NULL)
+    {
+      t->fpu_state = malloc (FPU_STATE_SIZE + FPU_STATE_ALIGN - 1);
+      if (t->fpu_state == NULL)
+        {
+          printf ("%s: dying due to interrupt %#04x (%s): "
+                  "out of memory for FPU state.\n",
+                  thread_name (), f->vec_no, intr_name (f->vec_no));
+          thread_exit ();
+        }
+      fresh = true;
+    }
+
+  old_level = intr_disable ();
+  trap_cnt++;
+  clear_ts ();
+  if (t->cpu->fpu_owner != t)
+    {
+      struct thread *owner = t->cpu->fpu_owner;
+      if (owner != NULL)
+        {
+          save_state (owner);
+          save_cnt++;
+        }
+      if (fresh)
+        {
+          asm volatile ("fninit");
+          if (sse_enabled)
+            {
+              uint32_t mxcsr = MXCSR_DEFAULT;
+              asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+            }
+        }
+      else
+        restore_state (t);
+      t->cpu->fpu_owner = t;
+    }
+  intr_set_level (old_level);
+}
@@ -13,13 +13,23 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/arena.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kstack.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
 #include "threads/pte.h"
+#include "threads/shrinker.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -38,6 +48,7 @@
 
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/page.h"
 #include "vm/swap.h"
 #endif
 
@@ -92,7 +103,13 @@ main (void)
   /* Initialize memory system. */
   palloc_init ();
   malloc_init ();
+  kmem_cache_init ();
+  arena_init ();
   paging_init ();
+  kstack_init ();
+#ifdef VM
+  init_page ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -102,6 +119,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -112,8 +130,13 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  cpu_detect ();
+  profile_init ();
+  trace_init ();
+  workqueue_init ();
   serial_init_queue ();
   timer_calibrate ();
+  cpu_start_aps ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -253,8 +276,29 @@ parse_options (char **argv)
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
+      else if (!strcmp (name, "-ks"))
+        {
+          int pages = value != NULL ? atoi (value) : 0;
+          if (pages < 1 || pages > KSTACK_PAGES_MAX)
+            PANIC ("-ks: pages must be between 1 and %d", KSTACK_PAGES_MAX);
+          kstack_pages = pages;
+        }
+      else if (!strcmp (name, "-intr-prof"))
+        intr_profile = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-mtrack"))
+        malloc_track = true;
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-stride"))
+        {
+          thread_stride_tickets = value != NULL ? atoi (value) : 0;
+          if (thread_stride_tickets < 1 || thread_stride_tickets > TICKETS_MAX)
+            PANIC ("-stride: tickets must be between 1 and %d", TICKETS_MAX);
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -304,6 +348,8 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"put", 2, fsutil_put},
       {"get", 2, fsutil_get},
+      {"dump-profile", 2, fsutil_dump_profile},
+      {"dump-trace", 2, fsutil_dump_trace},
 #endif
       {NULL, 0, NULL},
     };
@@ -350,6 +396,8 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  dump-profile FILE  Write profiler samples to FILE.\n"
+          "  dump-trace FILE    Write trace records to FILE.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  put FILE           Put FILE into file system from scratch disk.\n"
           "  get FILE           Get FILE from file system into scratch disk.\n"
@@ -359,7 +407,13 @@ usage (void)
           "  -q                 Power off VM after actions or on panic.\n"
           "  -f                 Format file system disk during startup.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
+          "  -ks=PAGES          Give each kernel stack PAGES pages.\n"
+          "  -intr-prof         Profile how long interrupts stay off.\n"
+          "  -profile           Sample the running code on each timer tick.\n"
+          "  -trace             Record tracepoints in a ring buffer.\n"
+          "  -mtrack            Report blocks still allocated, by call site.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -stride=TICKETS    Give each thread TICKETS stride tickets.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -398,6 +452,16 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  intr_print_stats ();
+  profile_print_stats ();
+  trace_print_stats ();
+  adaptive_lock_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_cache_print_stats ();
+  shrinker_print_stats ();
+  fpu_print_stats ();
+  workqueue_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
 #endif
@@ -3,12 +3,18 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/lapic.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Number of x86 interrupts. */
 #define INTR_CNT 256
@@ -26,18 +32,56 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 static const char *intr_names[INTR_CNT];
 
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
+   CPU, such as the timer, and by the local APICs.  External
+   interrupts run with interrupts turned off, so they never nest,
+   nor are they ever pre-empted.  Handlers for external
+   interrupts also may not sleep, although they may invoke
+   intr_yield_on_return() to request that a new process be
+   scheduled just before the interrupt returns.
+
+   Only the CPU holding the big kernel lock handles interrupts,
+   so these need not be per-CPU. */
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Interrupts-off profiling.
+
+   With intr_profile set, every interval during which interrupts
+   are off is timed with the time-stamp counter, from the
+   intr_disable() or intr_set_level() call that turned them off,
+   or from entry to an interrupt handler, until the intr_enable()
+   or intr_set_level() that turns them back on or the end of the
+   external interrupt handler.  Intervals that span a context
+   switch are charged to the thread that turned interrupts off.
+   An interval that ends with an "iret" back into a thread that
+   was preempted is not seen. */
+bool intr_profile;
+
+#define OFF_HIST_CNT 32         /* Histogram buckets, by log2 cycles. */
+#define OFF_SITE_CNT 8          /* Number of worst callers tracked. */
+
+/* A place that turns interrupts off. */
+struct off_site
+  {
+    void *caller;               /* Return address or handler. */
+    unsigned cnt;               /* Number of intervals. */
+    uint64_t max_cycles;        /* Longest interval. */
+  };
+
+static uint64_t off_since;      /* When interrupts went off, or 0. */
+static void *off_caller;        /* Who turned them off. */
+static unsigned long long off_cnt;      /* Number of intervals. */
+static unsigned long long off_hist[OFF_HIST_CNT]; /* Intervals, by log2. */
+static struct off_site off_sites[OFF_SITE_CNT]; /* Worst callers. */
+
+static enum intr_level disable (void *caller);
+static void off_start (void *caller);
+static void off_end (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
+static bool is_external (uint8_t vec_no);
 
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
@@ -67,7 +111,9 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  return (level == INTR_ON
+          ? intr_enable ()
+          : disable (__builtin_return_address (0)));
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
@@ -77,6 +123,9 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF)
+    off_end ();
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -89,6 +138,14 @@ intr_enable (void)
 /* Disables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_disable (void) 
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status.
+   CALLER is charged for the time they stay off. */
+static enum intr_level
+disable (void *caller) 
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -97,14 +154,99 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON)
+    off_start (caller);
   return old_level;
 }
+
+/* Notes that interrupts just went off because of CALLER. */
+static void
+off_start (void *caller) 
+{
+  if (intr_profile)
+    {
+      off_since = cpu_cycles ();
+      off_caller = caller;
+    }
+}
+
+/* Notes that interrupts are about to go back on, and records
+   how long they were off. */
+static void
+off_end (void) 
+{
+  uint64_t cycles;
+  struct off_site *s, *min;
+  int bucket;
+
+  if (!intr_profile || off_since == 0)
+    return;
+  cycles = cpu_cycles () - off_since;
+  off_since = 0;
+
+  off_cnt++;
+  bucket = 0;
+  while (bucket < OFF_HIST_CNT - 1 && cycles >> (bucket + 1) != 0)
+    bucket++;
+  off_hist[bucket]++;
+
+  /* Update the caller's site, or replace the site with the
+     shortest longest interval if this one is longer. */
+  min = off_sites;
+  for (s = off_sites; s < off_sites + OFF_SITE_CNT; s++)
+    {
+      if (s->caller == off_caller)
+        {
+          s->cnt++;
+          if (cycles > s->max_cycles)
+            s->max_cycles = cycles;
+          return;
+        }
+      if (s->max_cycles < min->max_cycles)
+        min = s;
+    }
+  if (cycles > min->max_cycles)
+    {
+      min->caller = off_caller;
+      min->cnt = 1;
+      min->max_cycles = cycles;
+    }
+}
+
+/* Prints interrupts-off statistics, if they were collected. */
+void
+intr_print_stats (void) 
+{
+  struct off_site *sorted[OFF_SITE_CNT];
+  int i, j;
+
+  if (!intr_profile)
+    return;
+
+  printf ("Interrupts off: %llu intervals\n", off_cnt);
+  for (i = 0; i < OFF_HIST_CNT; i++)
+    if (off_hist[i] != 0)
+      printf ("  %10llu-%llu cycles: %llu\n",
+              i == 0 ? 0 : 1ULL << i, (2ULL << i) - 1, off_hist[i]);
+
+  /* Insertion sort by longest interval, longest first. */
+  for (i = 0; i < OFF_SITE_CNT; i++)
+    {
+      for (j = i; j > 0 && sorted[j - 1]->max_cycles < off_sites[i].max_cycles;
+           j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = &off_sites[i];
+    }
+  printf ("Interrupts off longest, by caller (see utils/backtrace):\n");
+  for (i = 0; i < OFF_SITE_CNT && sorted[i]->cnt != 0; i++)
+    printf ("  %p: %llu cycles, %u intervals\n", sorted[i]->caller,
+            sorted[i]->max_cycles, sorted[i]->cnt);
+}
 
 /* Initializes the interrupt system. */
 void
 intr_init (void)
 {
-  uint64_t idtr_operand;
   int i;
 
   /* Initialize interrupt controller. */
@@ -114,11 +256,8 @@ intr_init (void)
   for (i = 0; i < INTR_CNT; i++)
     idt[i] = make_intr_gate (intr_stubs[i], 0);
 
-  /* Load IDT register.
-     See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
-     Descriptor Table (IDT)". */
-  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
-  asm volatile ("lidt %0" : : "m" (idtr_operand));
+  /* Load IDT register. */
+  intr_init_ap ();
 
   /* Initialize intr_names. */
   for (i = 0; i < INTR_CNT; i++)
@@ -144,6 +283,19 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT, which every CPU shares, into the running CPU.
+   Called by intr_init() and by each application processor. */
+void
+intr_init_ap (void)
+{
+  uint64_t idtr_operand;
+
+  /* See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
+     Descriptor Table (IDT)". */
+  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -168,7 +320,7 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -189,10 +341,27 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
+/* Registers internal interrupt VEC_NO to switch to the task
+   whose TSS has selector TSS_SEL, which is named NAME for
+   debugging purposes.  A task gate runs its handler on a stack of
+   its own, so it can handle faults, such as a double fault from
+   a kernel stack overflow, that leave the interrupted stack
+   unusable.  See [IA32-v3a] 5.12.2 "Interrupt Tasks". */
+void
+intr_register_task (uint8_t vec_no, uint16_t tss_sel, const char *name)
+{
+  ASSERT (!is_external (vec_no));
+  ASSERT (intr_handlers[vec_no] == NULL);
+  idt[vec_no] = ((uint64_t) ((1 << 15)          /* Present. */
+                             | (5 << 8)) << 32) /* Task gate. */
+                | ((uint32_t) tss_sel << 16);   /* TSS selector. */
+  intr_names[vec_no] = name;
+}
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
@@ -212,6 +381,14 @@ intr_yield_on_return (void)
   yield_on_return = true;
 }
 
+/* Returns true if VEC_NO is an external interrupt's vector,
+   from a PIC or a local APIC. */
+static bool
+is_external (uint8_t vec_no)
+{
+  return (vec_no >= 0x20 && vec_no <= 0x2f) || vec_no >= LAPIC_VEC_TIMER;
+}
+
 /* 8259A Programmable Interrupt Controller. */
 
 /* Every PC has two 8259A Programmable Interrupt Controller (PIC)
@@ -341,11 +518,28 @@ intr_handler (struct intr_frame *frame)
   bool external;
   intr_handler_func *handler;
 
+  /* A TLB shootdown only touches this CPU, and its sender holds
+     the big kernel lock while it waits for the answer, so it is
+     answered without the lock.  A spurious interrupt from the
+     local APIC needs no answer at all. */
+  if (frame->vec_no == LAPIC_VEC_FLUSH)
+    {
+      cpu_flush_ack ();
+      lapic_eoi ();
+      return;
+    }
+  if (frame->vec_no == LAPIC_VEC_SPURIOUS)
+    return;
+
+  /* Enter the kernel proper.  The lock is already held if we
+     interrupted kernel code, other than the idle loop's "hlt". */
+  big_lock_enter ();
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).  An external interrupt handler cannot sleep. */
+  external = is_external (frame->vec_no);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
@@ -357,6 +551,8 @@ intr_handler (struct intr_frame *frame)
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
+  if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF)
+    off_start (handler);
   if (handler != NULL)
     handler (frame);
   else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
@@ -380,11 +576,36 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_context ());
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
-
+      if (frame->vec_no >= LAPIC_VEC_TIMER)
+        lapic_eoi ();
+      else
+        pic_end_of_interrupt (frame->vec_no); 
+
+      /* If we yield, interrupts stay off until the next thread
+         turns them on.  schedule() counts the yield as a
+         preemption. */
       if (yield_on_return) 
-        thread_yield (); 
+        {
+          thread_current ()->preempted = true;
+          thread_yield (); 
+        }
+      else
+        off_end ();
     }
+
+#ifdef USERPROG
+  /* A thread whose process is exiting must not go back to user
+     mode. */
+  if (frame->cs == SEL_UCSEG)
+    process_check_exit ();
+#endif
+
+  /* A CPU that keeps running kernel code lets the others in at
+     each external interrupt that found interrupts on, where
+     anything could have run anyway.  Returns to user mode
+     release the lock in intr_exit instead. */
+  if (external && (frame->eflags & FLAG_IF) && (frame->cs & 3) == 0)
+    big_lock_yield ();
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
@@ -0,0 +1,224 @@
+#include "threads/kstack.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+
+/* Kernel stacks.
+
+   Each thread, other than the initial thread, gets a slot of
+   kstack_slot_size bytes in a dedicated region of kernel virtual
+   memory above the physical memory mapping.  The slot is laid
+   out like this:
+
+     slot + kstack_slot_size +-----------------------------+
+                             |        kernel stack         |
+                             |  (kstack_pages pages, grows |
+                             |          downward)          |
+                             +-----------------------------+
+                             |    guard (never mapped)     |
+                             +-----------------------------+
+                             |       struct thread         |
+                        slot +-----------------------------+
+
+   Only the thread page and the stack pages are backed by memory,
+   taken from the kernel pool.  A stack that overflows runs into
+   the guard and faults at once, instead of silently corrupting
+   the struct thread below it.  Because the slot size is a power
+   of two, the running thread is still found by rounding the
+   stack pointer down: see kstack_owner().
+
+   The region's page tables are created by kstack_init() in the
+   base page directory, before any process page directory is
+   copied from it, so every address space shares them. */
+size_t kstack_pages = 1;
+size_t kstack_slot_size;
+
+/* Free and used slots.  Protected by disabling interrupts. */
+static struct bitmap *slots;
+
+static uint32_t *lookup (const void *);
+static bool map_page (void *);
+static void unmap_page (void *);
+
+/* Sets up the kernel stack region.  Must be called after
+   paging_init() and malloc_init(), and before any thread is
+   created. */
+void
+kstack_init (void)
+{
+  size_t slot_pages;
+  uint8_t *p;
+
+  ASSERT (kstack_pages >= 1 && kstack_pages <= KSTACK_PAGES_MAX);
+  ASSERT ((uint8_t *) ptov (ram_pages * PGSIZE) <= KSTACK_BASE);
+
+  /* A thread page, at least one guard page, and the stack. */
+  for (slot_pages = 1; slot_pages < kstack_pages + 2; slot_pages *= 2)
+    continue;
+  kstack_slot_size = slot_pages * PGSIZE;
+
+  for (p = KSTACK_BASE; p < KSTACK_BASE + KSTACK_REGION_SIZE;
+       p += PGSIZE << PDBITS)
+    {
+      uint32_t *pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      base_page_dir[pd_no (p)] = pde_create (pt);
+    }
+
+  slots = bitmap_create (KSTACK_REGION_SIZE / kstack_slot_size);
+  if (slots == NULL)
+    PANIC ("kstack: out of memory for slot bitmap");
+}
+
+/* Allocates a slot and backs its thread page and stack with
+   memory.  Returns the start of the slot, where the struct
+   thread goes, or a null pointer if memory or slots run out. */
+void *
+kstack_alloc (void)
+{
+  enum intr_level old_level;
+  uint8_t *slot, *stack;
+  size_t idx, i;
+
+  old_level = intr_disable ();
+  idx = bitmap_scan_and_flip (slots, 0, 1, false);
+  intr_set_level (old_level);
+  if (idx == BITMAP_ERROR)
+    return NULL;
+
+  slot = KSTACK_BASE + idx * kstack_slot_size;
+  stack = slot + kstack_slot_size - kstack_pages * PGSIZE;
+  if (!map_page (slot))
+    goto error;
+  for (i = 0; i < kstack_pages; i++)
+    if (!map_page (stack + i * PGSIZE))
+      goto error;
+  return slot;
+
+ error:
+  kstack_free (slot);
+  return NULL;
+}
+
+/* Frees SLOT, which was returned by kstack_alloc(), and its
+   memory.  SLOT's thread must not be running. */
+void
+kstack_free (void *slot_)
+{
+  uint8_t *slot = slot_;
+  uint8_t *stack;
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (kstack_in_region (slot));
+  ASSERT (kstack_owner (slot) == slot);
+
+  stack = slot + kstack_slot_size - kstack_pages * PGSIZE;
+  unmap_page (slot);
+  for (i = 0; i < kstack_pages; i++)
+    unmap_page (stack + i * PGSIZE);
+
+  old_level = intr_disable ();
+  bitmap_reset (slots, (slot - KSTACK_BASE) / kstack_slot_size);
+  intr_set_level (old_level);
+}
+
+/* Frees the stack pages of SLOT, which was returned by
+   kstack_alloc(), but keeps the slot and its thread page.
+   Returns the number of pages freed.  SLOT's thread must not be
+   running; kstack_refill() backs the stack again. */
+size_t
+kstack_trim (void *slot_)
+{
+  uint8_t *slot = slot_;
+  uint8_t *stack;
+  size_t freed = 0;
+  size_t i;
+
+  ASSERT (kstack_in_region (slot));
+  ASSERT (kstack_owner (slot) == slot);
+
+  stack = slot + kstack_slot_size - kstack_pages * PGSIZE;
+  for (i = 0; i < kstack_pages; i++)
+    if (*lookup (stack + i * PGSIZE) & PTE_P)
+      {
+        unmap_page (stack + i * PGSIZE);
+        freed++;
+      }
+  return freed;
+}
+
+/* Backs whatever part of SLOT's stack kstack_trim() freed with
+   memory again.  Returns true if successful, false if memory ran
+   out, in which case SLOT may be trimmed again or freed. */
+bool
+kstack_refill (void *slot_)
+{
+  uint8_t *slot = slot_;
+  uint8_t *stack;
+  size_t i;
+
+  ASSERT (kstack_in_region (slot));
+  ASSERT (kstack_owner (slot) == slot);
+
+  stack = slot + kstack_slot_size - kstack_pages * PGSIZE;
+  for (i = 0; i < kstack_pages; i++)
+    if (!(*lookup (stack + i * PGSIZE) & PTE_P)
+        && !map_page (stack + i * PGSIZE))
+      return false;
+  return true;
+}
+
+/* Returns true if P lies in the guard of some thread's slot. */
+bool
+kstack_is_guard (const void *p)
+{
+  size_t ofs;
+
+  if (!kstack_in_region (p))
+    return false;
+  ofs = (const uint8_t *) p - (const uint8_t *) kstack_owner (p);
+  return ofs >= PGSIZE && ofs < kstack_slot_size - kstack_pages * PGSIZE;
+}
+
+/* Returns the page table entry for VADDR in the region. */
+static uint32_t *
+lookup (const void *vaddr)
+{
+  ASSERT (kstack_in_region (vaddr));
+  return pde_get_pt (base_page_dir[pd_no (vaddr)]) + pt_no (vaddr);
+}
+
+/* Backs the page at VADDR with a new page from the kernel pool.
+   Returns true if successful, false if memory ran out. */
+static bool
+map_page (void *vaddr)
+{
+  void *page = palloc_get_page (0);
+
+  if (page == NULL)
+    return false;
+  *lookup (vaddr) = pte_create_kernel (page, true);
+  return true;
+}
+
+/* Unmaps the page at VADDR, if it is mapped, and frees it.
+   Every CPU may have the mapping cached, since the stack area is
+   shared by all page directories. */
+static void
+unmap_page (void *vaddr)
+{
+  uint32_t *pte = lookup (vaddr);
+
+  if (*pte & PTE_P)
+    {
+      void *page = pte_get_page (*pte);
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      cpu_flush_tlbs (NULL);
+      palloc_free_page (page);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef THREADS_KSTACK_H
+#define THREADS_KSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+/* Kernel stack region.  Every thread but the initial one lives
+   in a slot of KSTACK_SLOT_SIZE bytes here: see kstack.c. */
+#define KSTACK_BASE ((uint8_t *) 0xe0000000)
+#define KSTACK_REGION_SIZE (32 * 1024 * 1024)
+
+/* Most pages a kernel stack may have. */
+#define KSTACK_PAGES_MAX 14
+
+/* Pages in each thread's kernel stack.  Controlled by kernel
+   command-line option "-ks=PAGES". */
+extern size_t kstack_pages;
+
+/* Bytes in a slot, a power of two.  Set by kstack_init(). */
+extern size_t kstack_slot_size;
+
+void kstack_init (void);
+void *kstack_alloc (void);
+void kstack_free (void *);
+size_t kstack_trim (void *);
+bool kstack_refill (void *);
+bool kstack_is_guard (const void *);
+
+/* Returns true if P lies in the kernel stack region. */
+static inline bool
+kstack_in_region (const void *p)
+{
+  return (uintptr_t) p - (uintptr_t) KSTACK_BASE < KSTACK_REGION_SIZE;
+}
+
+/* Returns the start of the thread slot that contains P, which
+   may be a stack address.  Outside the region, that is the start
+   of P's page, as for the initial thread. */
+static inline void *
+kstack_owner (const void *p)
+{
+  if (kstack_in_region (p))
+    return (void *) ((uintptr_t) p & ~(kstack_slot_size - 1));
+  return pg_round_down (p);
+}
+
+/* Returns the top of the kernel stack of the thread at T. */
+static inline void *
+kstack_top (void *t)
+{
+  return (uint8_t *) t + (kstack_in_region (t) ? kstack_slot_size : PGSIZE);
+}
+
+#endif /* threads/kstack.h */
@@ -0,0 +1,258 @@
+#include "threads/lapic.h"
+#include <debug.h>
+#include <stdbool.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* Local APIC.
+
+   Each CPU has a local APIC, which delivers its interrupts,
+   sends interprocessor interrupts (IPIs) to the other CPUs and
+   has a timer of its own.  The bootstrap processor still gets
+   device interrupts from the 8259A PICs, through its LINT0 pin in
+   "virtual wire" mode, and still counts ticks with the 8254; its
+   local APIC is only used for IPIs.  The application processors
+   get no device interrupts at all, only IPIs and a periodic local
+   APIC timer that drives their schedulers.
+
+   The registers are memory-mapped, in one page that every CPU
+   sees at the same physical address but that reaches its own
+   local APIC.  See [IA32-v3a] chapter 10 "Advanced Programmable
+   Interrupt Controller (APIC)". */
+
+/* Virtual address at which the registers are mapped. */
+#define LAPIC_VADDR 0xfee00000
+
+/* Register offsets, in bytes. */
+#define REG_ID 0x020            /* Local APIC ID. */
+#define REG_TPR 0x080           /* Task priority. */
+#define REG_EOI 0x0b0           /* End of interrupt. */
+#define REG_SVR 0x0f0           /* Spurious interrupt vector. */
+#define REG_ESR 0x280           /* Error status. */
+#define REG_ICRLO 0x300         /* Interrupt command, low half. */
+#define REG_ICRHI 0x310         /* Interrupt command, high half. */
+#define REG_TIMER 0x320         /* LVT timer. */
+#define REG_LINT0 0x350         /* LVT LINT0 pin. */
+#define REG_LINT1 0x360         /* LVT LINT1 pin. */
+#define REG_ERROR 0x370         /* LVT error. */
+#define REG_TICR 0x380          /* Timer initial count. */
+#define REG_TCCR 0x390          /* Timer current count. */
+#define REG_TDCR 0x3e0          /* Timer divide configuration. */
+
+#define SVR_ENABLE 0x100        /* Software enable. */
+
+/* Local vector table entry bits. */
+#define LVT_EXTINT 0x700        /* Deliver as if from a PIC. */
+#define LVT_NMI 0x400           /* Deliver as an NMI. */
+#define LVT_MASKED 0x10000      /* Masked. */
+#define LVT_PERIODIC 0x20000    /* Periodic timer, not one-shot. */
+
+#define TDCR_16 0x3             /* Timer counts at bus clock / 16. */
+
+/* Interrupt command register bits. */
+#define ICR_FIXED 0x000         /* Deliver the vector. */
+#define ICR_INIT 0x500          /* INIT. */
+#define ICR_STARTUP 0x600       /* Startup IPI. */
+#define ICR_PENDING 0x1000      /* Not yet accepted. */
+#define ICR_ASSERT 0x4000       /* Assert, rather than de-assert. */
+#define ICR_LEVEL 0x8000        /* Level, rather than edge, triggered. */
+
+/* Timer ticks to calibrate the local APIC timer over. */
+#define CALIBRATE_TICKS 10
+
+/* Local APIC timer counts per timer tick. */
+static uint32_t counts_per_tick;
+
+static intr_handler_func timer_interrupt, kick_interrupt;
+static void setup (bool bsp);
+static void calibrate (void);
+static void send (uint8_t apic_id, uint32_t icr);
+
+/* Returns local APIC register REG. */
+static inline uint32_t
+lapic_read (int reg)
+{
+  return ((volatile uint32_t *) LAPIC_VADDR)[reg / 4];
+}
+
+/* Sets local APIC register REG to VALUE. */
+static inline void
+lapic_write (int reg, uint32_t value)
+{
+  ((volatile uint32_t *) LAPIC_VADDR)[reg / 4] = value;
+}
+
+/* Maps the local APICs' registers, which are at physical address
+   PHYS, enables the bootstrap processor's local APIC, and
+   calibrates the local APIC timer against the 8254.
+
+   The mapping goes into the base page directory, so this must be
+   called before any process page directory is copied from it.
+   Interrupts must be on, and timer_calibrate() must have run. */
+void
+lapic_init (uintptr_t phys)
+{
+  void *vaddr = (void *) LAPIC_VADDR;
+  uint32_t *pt;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (phys % PGSIZE == 0);
+  ASSERT (base_page_dir[pd_no (vaddr)] == 0);
+
+  /* Device memory must not be cached. */
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  base_page_dir[pd_no (vaddr)] = pde_create (pt);
+  pt[pt_no (vaddr)] = phys | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+
+  intr_register_ext (LAPIC_VEC_TIMER, timer_interrupt, "Local APIC Timer");
+  intr_register_ext (LAPIC_VEC_KICK, kick_interrupt, "Kick IPI");
+
+  setup (true);
+  calibrate ();
+}
+
+/* Enables the running application processor's local APIC. */
+void
+lapic_init_ap (void)
+{
+  setup (false);
+}
+
+/* Starts the running application processor's local APIC timer,
+   which interrupts it once per timer tick. */
+void
+lapic_timer_start (void)
+{
+  lapic_write (REG_TDCR, TDCR_16);
+  lapic_write (REG_TIMER, LVT_PERIODIC | LAPIC_VEC_TIMER);
+  lapic_write (REG_TICR, counts_per_tick);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  return lapic_read (REG_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled. */
+void
+lapic_eoi (void)
+{
+  lapic_write (REG_EOI, 0);
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is
+   APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  send (apic_id, ICR_FIXED | vec);
+}
+
+/* Starts the application processor whose local APIC ID is
+   APIC_ID running in real mode at physical address START, which
+   must be page-aligned and below 1 MB, with the INIT, startup,
+   startup sequence of [MP] B.4 "Application Processor Startup".
+   Interrupts must be on. */
+void
+lapic_start_ap (uint8_t apic_id, uintptr_t start)
+{
+  int i;
+
+  ASSERT (start % PGSIZE == 0 && start < 0x100000);
+
+  send (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_usleep (200);
+  send (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_msleep (10);
+
+  for (i = 0; i < 2; i++)
+    {
+      send (apic_id, ICR_STARTUP | (start >> PGBITS));
+      timer_usleep (200);
+    }
+}
+
+/* Sets up the running CPU's local APIC.  On the bootstrap
+   processor, BSP, the PICs keep reaching it through LINT0. */
+static void
+setup (bool bsp)
+{
+  lapic_write (REG_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+  lapic_write (REG_TDCR, TDCR_16);
+  lapic_write (REG_TIMER, LVT_MASKED);
+  lapic_write (REG_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+  lapic_write (REG_LINT1, bsp ? LVT_NMI : LVT_MASKED);
+  lapic_write (REG_ERROR, LVT_MASKED);
+
+  /* Clear errors, which takes two writes, and anything that was
+     being handled, then accept every interrupt. */
+  lapic_write (REG_ESR, 0);
+  lapic_write (REG_ESR, 0);
+  lapic_write (REG_EOI, 0);
+  lapic_write (REG_TPR, 0);
+}
+
+/* Measures counts_per_tick by letting the bootstrap processor's
+   local APIC timer count down for CALIBRATE_TICKS ticks. */
+static void
+calibrate (void)
+{
+  int64_t start;
+
+  lapic_write (REG_TIMER, LVT_MASKED | LAPIC_VEC_TIMER);
+
+  /* Start at the beginning of a tick. */
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    barrier ();
+
+  lapic_write (REG_TICR, UINT32_MAX);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < CALIBRATE_TICKS)
+    barrier ();
+  counts_per_tick = (UINT32_MAX - lapic_read (REG_TCCR)) / CALIBRATE_TICKS;
+  lapic_write (REG_TICR, 0);
+}
+
+/* Sends interrupt command ICR to the CPU whose local APIC ID is
+   APIC_ID and waits for it to be accepted.  Interrupts are kept
+   off, so that an interrupt handler cannot send an IPI of its own
+   between the two register writes. */
+static void
+send (uint8_t apic_id, uint32_t icr)
+{
+  enum intr_level old_level = intr_disable ();
+
+  lapic_write (REG_ICRHI, (uint32_t) apic_id << 24);
+  lapic_write (REG_ICRLO, icr);
+  while (lapic_read (REG_ICRLO) & ICR_PENDING)
+    asm volatile ("pause");
+
+  intr_set_level (old_level);
+}
+
+/* Local APIC timer interrupt handler, on application processors.
+   Only the 8254's handler counts ticks and wakes sleepers; this
+   one just drives its CPU's scheduler. */
+static void
+timer_interrupt (struct intr_frame *args)
+{
+  profile_sample (args);
+  thread_tick ();
+}
+
+/* Kick IPI handler.  Does nothing: waking the CPU from the "hlt"
+   in its idle loop is the point. */
+static void
+kick_interrupt (struct intr_frame *args UNUSED)
+{
+}
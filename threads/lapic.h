@@ -0,0 +1,23 @@
+#ifndef THREADS_LAPIC_H
+#define THREADS_LAPIC_H
+
+#include <stdint.h>
+
+/* Interrupt vectors delivered by the local APICs.  All of them
+   are above the PIC's 0x20...0x2f and are handled as external
+   interrupts, except for LAPIC_VEC_FLUSH and LAPIC_VEC_SPURIOUS,
+   which intr_handler() deals with itself. */
+#define LAPIC_VEC_TIMER 0xf0    /* Application processor timer. */
+#define LAPIC_VEC_KICK 0xf1     /* Wakes an idle CPU. */
+#define LAPIC_VEC_FLUSH 0xfe    /* TLB shootdown: see cpu_flush_tlbs(). */
+#define LAPIC_VEC_SPURIOUS 0xff /* Spurious interrupt. */
+
+void lapic_init (uintptr_t phys);
+void lapic_init_ap (void);
+void lapic_timer_start (void);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uintptr_t start);
+
+#endif /* threads/lapic.h */
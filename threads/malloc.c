@@ -5,7 +5,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -32,7 +35,26 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Taking a descriptor's lock on every call would make malloc()
+   and free() block whenever two threads use the same block
+   size.  So each CPU also keeps a "magazine" of free blocks for
+   each descriptor, which it uses with interrupts off instead of
+   a lock.  malloc() takes a block from the magazine, and free()
+   puts one back.  Only when the magazine is empty, or full, do
+   they take the lock, to move MAG_BATCH blocks between it and
+   the descriptor's free list at once.  A block in a magazine
+   still counts as in use in its arena, so under memory pressure
+   a shrinker empties the running CPU's magazines.
+
+   Each CPU counts the blocks it allocates and frees in each size
+   class, for malloc_print_stats().  With "-mtrack", malloc() also
+   records the caller of every allocation in a table of call
+   sites, and the index of its entry in the last word of the
+   block, so that free() can find it again.  Sites with blocks
+   still allocated at shutdown are reported, which is a good
+   place to start looking for leaks. */
 
 /* Descriptor. */
 struct desc
@@ -40,7 +62,10 @@ struct desc
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
-    struct lock lock;           /* Lock. */
+    struct adaptive_lock lock;  /* Lock. */
+    char name[16];              /* Lock name, e.g. "malloc 64". */
+    size_t arena_cnt;           /* Number of arenas, under lock. */
+    size_t arena_peak;          /* Maximum value of arena_cnt. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,11 +86,79 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+#define DESC_MAX 10
+static struct desc descs[DESC_MAX]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Magazine of free blocks for one CPU and descriptor. */
+#define MAG_SIZE 16             /* Blocks a magazine holds. */
+#define MAG_BATCH (MAG_SIZE / 2) /* Blocks moved to or from a descriptor. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks. */
+    struct block *blocks[MAG_SIZE]; /* Blocks, most recently freed last. */
+  };
+
+/* Magazines, indexed by CPU and descriptor.  Each may only be
+   touched by its own CPU with interrupts off. */
+static struct magazine mags[CPU_MAX][DESC_MAX];
+
+/* Empties magazines under memory pressure. */
+static struct shrinker shrinker;
+
+/* Size class of big blocks, after the descriptors'. */
+#define BIG_CLASS DESC_MAX
+
+/* Counts for one CPU and size class.  Each may only be touched
+   by its own CPU with interrupts off. */
+struct class_stats
+  {
+    unsigned long long alloc_cnt;       /* # of blocks allocated. */
+    unsigned long long free_cnt;        /* # of blocks freed. */
+    unsigned long long req_bytes;       /* Bytes asked for. */
+    unsigned long long got_bytes;       /* Bytes handed out for them. */
+    unsigned long long freed_bytes;     /* Bytes given back. */
+  };
+static struct class_stats stats[CPU_MAX][DESC_MAX + 1];
+
+/* Call site tracking, enabled by "-mtrack". */
+bool malloc_track;
+
+/* A call site of malloc(), calloc(), or realloc(). */
+#define SITE_CNT 128
+struct site
+  {
+    const void *caller;                 /* Return address, or null. */
+    unsigned long long alloc_cnt;       /* # of blocks allocated. */
+    unsigned long long free_cnt;        /* # of blocks freed. */
+    size_t live_bytes;                  /* Bytes in blocks not freed. */
+  };
+
+/* Call sites, in an open-addressed hash table keyed on CALLER. */
+static struct site sites[SITE_CNT];
+static unsigned long long untracked_cnt; /* Allocations with no site. */
+static struct adaptive_lock site_lock;   /* Protects the above. */
+
+static struct magazine *get_magazine (struct desc *);
+static struct block *refill (struct desc *);
+static struct block *take_block (struct desc *);
+static void put_blocks (struct desc *, struct block **, size_t cnt);
+static size_t return_blocks (struct desc *, struct block **, size_t cnt);
+static shrink_func shrink_magazines;
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *alloc (size_t size, const void *caller);
+static struct desc *find_desc (size_t size);
+static size_t block_size (void *block);
+static bool resize (void *block, size_t size);
+static void count_alloc (size_t class, size_t size, size_t got);
+static void count_free (size_t class, size_t freed);
+static void count_resize (size_t class, size_t old_size, size_t new_size,
+                          size_t req_size);
+static unsigned *site_idx (void *block);
+static void track_alloc (void *block, const void *caller);
+static void track_free (void *block);
+static void track_resize (void *block, unsigned site, size_t old_size);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -76,12 +169,17 @@ malloc_init (void)
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      ASSERT (desc_cnt <= DESC_MAX);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      snprintf (d->name, sizeof d->name, "malloc %zu", block_size);
+      adaptive_lock_init (&d->lock, d->name);
+      d->arena_cnt = d->arena_peak = 0;
     }
+  adaptive_lock_init (&site_lock, "malloc sites");
+  shrinker_register (&shrinker, "malloc magazines", SHRINK_CACHE,
+                     shrink_magazines);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -89,20 +187,31 @@ malloc_init (void)
 void *
 malloc (size_t size) 
 {
+  return alloc (size, __builtin_return_address (0));
+}
+
+/* Allocates a block of at least SIZE bytes, on behalf of the
+   code that will return to CALLER.  Implements malloc(). */
+static void *
+alloc (size_t size, const void *caller) 
+{
+  size_t req_size = size;
   struct desc *d;
+  struct magazine *m;
   struct block *b;
   struct arena *a;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
     return NULL;
 
-  /* Find the smallest descriptor that satisfies a SIZE-byte
-     request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  /* Make room for the call site. */
+  if (malloc_track)
+    size += sizeof (unsigned);
+
+  d = find_desc (size);
+  if (d == NULL) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -116,40 +225,27 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
-      return a + 1;
+      b = (struct block *) (a + 1);
+      count_alloc (BIG_CLASS, req_size, block_size (b));
     }
-
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  else
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
+      /* Take a block from this CPU's magazine if it has one. */
+      old_level = intr_disable ();
+      m = get_magazine (d);
+      b = m->cnt > 0 ? m->blocks[--m->cnt] : NULL;
+      intr_set_level (old_level);
+      if (b == NULL)
         {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
+          b = refill (d);
+          if (b == NULL)
+            return NULL;
         }
+      count_alloc (d - descs, req_size, d->block_size);
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  if (malloc_track)
+    track_alloc (b, caller);
   return b;
 }
 
@@ -167,13 +263,26 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
   return p;
 }
 
+/* Returns the smallest descriptor that satisfies a SIZE-byte
+   request, or a null pointer if SIZE needs a big block. */
+static struct desc *
+find_desc (size_t size) 
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      return d;
+  return NULL;
+}
+
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) 
@@ -186,7 +295,9 @@ block_size (void *block)
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
-   moving it in the process.
+   moving it in the process.  The block stays where it is if
+   NEW_SIZE is for the same descriptor or, for a big block, if it
+   needs fewer pages or the pages that follow it are free.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
@@ -199,13 +310,19 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize (old_block, new_size))
+    return old_block;
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc (new_size, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
-          size_t min_size = new_size < old_size ? new_size : old_size;
+          size_t min_size;
+
+          if (malloc_track)
+            old_size -= sizeof (unsigned);
+          min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
           free (old_block);
         }
@@ -213,6 +330,48 @@ realloc (void *old_block, size_t new_size)
     }
 }
 
+/* Tries to make BLOCK hold SIZE bytes without moving it, and
+   returns true if successful. */
+static bool
+resize (void *block, size_t size) 
+{
+  struct arena *a = block_to_arena (block);
+  size_t old_size = block_size (block);
+  size_t req_size = size;
+  size_t page_cnt;
+  unsigned site = SITE_CNT;
+
+  if (malloc_track)
+    size += sizeof (unsigned);
+
+  /* A small block can only stay in its own descriptor. */
+  if (a->desc != NULL || find_desc (size) != NULL)
+    {
+      if (find_desc (size) != a->desc)
+        return false;
+      count_resize (a->desc - descs, old_size, old_size, req_size);
+      return true;
+    }
+
+  /* A big block shrinks by freeing pages at its end, and grows
+     by taking the free pages that follow it. */
+  page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+  if (malloc_track)
+    site = *site_idx (block);
+  if (page_cnt < a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                          a->free_cnt - page_cnt);
+  else if (page_cnt > a->free_cnt
+           && !palloc_extend (a, a->free_cnt, page_cnt))
+    return false;
+  a->free_cnt = page_cnt;
+
+  count_resize (BIG_CLASS, old_size, block_size (block), req_size);
+  if (malloc_track)
+    track_resize (block, site, old_size);
+  return true;
+}
+
 /* Frees block P, which must have been previously allocated with
    malloc(), calloc(), or realloc(). */
 void
@@ -223,36 +382,44 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+
+      if (malloc_track)
+        track_free (b);
+      count_free (d != NULL ? (size_t) (d - descs) : BIG_CLASS,
+                  block_size (b));
       
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
 
+          struct block *batch[MAG_BATCH];
+          struct magazine *m;
+          enum intr_level old_level;
+          bool drain;
+
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in this CPU's magazine, first moving
+             the oldest half of it to a batch if it is full. */
+          old_level = intr_disable ();
+          m = get_magazine (d);
+          drain = m->cnt == MAG_SIZE;
+          if (drain)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              memcpy (batch, m->blocks, sizeof batch);
+              memmove (m->blocks, m->blocks + MAG_BATCH,
+                       (MAG_SIZE - MAG_BATCH) * sizeof *m->blocks);
+              m->cnt -= MAG_BATCH;
             }
+          m->blocks[m->cnt++] = b;
+          intr_set_level (old_level);
 
-          lock_release (&d->lock);
+          /* Give the batch back to the descriptor. */
+          if (drain)
+            put_blocks (d, batch, MAG_BATCH);
         }
       else
         {
@@ -263,6 +430,231 @@ free (void *p)
     }
 }
 
+/* Prints, for each size class in use, the number of blocks
+   allocated, freed, and still in use, the number of arenas, and
+   the bytes lost to rounding sizes up.  With "-mtrack", also
+   prints each call site that has blocks still in use. */
+void
+malloc_print_stats (void) 
+{
+  size_t class, i;
+
+  for (class = 0; class <= BIG_CLASS; class++)
+    {
+      struct class_stats sum = { 0, 0, 0, 0, 0 };
+      int cpu;
+
+      if (class >= desc_cnt && class != BIG_CLASS)
+        continue;
+      for (cpu = 0; cpu < CPU_MAX; cpu++)
+        {
+          struct class_stats *s = &stats[cpu][class];
+          sum.alloc_cnt += s->alloc_cnt;
+          sum.free_cnt += s->free_cnt;
+          sum.req_bytes += s->req_bytes;
+          sum.got_bytes += s->got_bytes;
+          sum.freed_bytes += s->freed_bytes;
+        }
+      if (sum.alloc_cnt == 0)
+        continue;
+
+      if (class != BIG_CLASS)
+        printf ("malloc %zu: %llu allocs, %llu frees, %llu in use, "
+                "%zu arenas (peak %zu), %llu bytes wasted\n",
+                descs[class].block_size, sum.alloc_cnt, sum.free_cnt,
+                sum.alloc_cnt - sum.free_cnt, descs[class].arena_cnt,
+                descs[class].arena_peak, sum.got_bytes - sum.req_bytes);
+      else
+        printf ("malloc big: %llu allocs, %llu frees, %llu in use, "
+                "%llu pages, %llu bytes wasted\n",
+                sum.alloc_cnt, sum.free_cnt, sum.alloc_cnt - sum.free_cnt,
+                DIV_ROUND_UP (sum.got_bytes - sum.freed_bytes, PGSIZE),
+                sum.got_bytes - sum.req_bytes);
+    }
+
+  if (!malloc_track)
+    return;
+  for (i = 0; i < SITE_CNT; i++)
+    {
+      struct site *s = &sites[i];
+      if (s->caller != NULL && s->alloc_cnt > s->free_cnt)
+        printf ("malloc site %p: %llu allocs, %llu frees, "
+                "%zu bytes in use\n",
+                s->caller, s->alloc_cnt, s->free_cnt, s->live_bytes);
+    }
+  if (untracked_cnt > 0)
+    printf ("malloc: %llu allocs not tracked, site table full\n",
+            untracked_cnt);
+}
+
+/* Returns the running CPU's magazine for descriptor D.
+   Interrupts must be off. */
+static struct magazine *
+get_magazine (struct desc *d)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return &mags[cpu_current ()->id][d - descs];
+}
+
+/* Takes MAG_BATCH blocks from D, or as many as are available,
+   and puts all but one of them in the running CPU's magazine.
+   Returns the other, or a null pointer if memory is not
+   available. */
+static struct block *
+refill (struct desc *d)
+{
+  struct block *batch[MAG_BATCH];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  adaptive_lock_acquire (&d->lock);
+  for (cnt = 0; cnt < MAG_BATCH; cnt++)
+    {
+      batch[cnt] = take_block (d);
+      if (batch[cnt] == NULL)
+        break;
+    }
+  adaptive_lock_release (&d->lock);
+  if (cnt == 0)
+    return NULL;
+
+  /* We may have moved to another CPU, or another thread may have
+     filled the magazine, while we held the lock.  Whatever does
+     not fit goes back. */
+  old_level = intr_disable ();
+  m = get_magazine (d);
+  for (i = 1; i < cnt && m->cnt < MAG_SIZE; i++)
+    m->blocks[m->cnt++] = batch[i];
+  intr_set_level (old_level);
+  if (i < cnt)
+    put_blocks (d, batch + i, cnt - i);
+
+  return batch[0];
+}
+
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty, and returns it.  Returns a null pointer if
+   memory is not available.  D's lock must be held. */
+static struct block *
+take_block (struct desc *d)
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (adaptive_lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        return NULL; 
+      if (++d->arena_cnt > d->arena_peak)
+        d->arena_peak = d->arena_cnt;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Puts the CNT blocks in BLOCKS back on D's free list, freeing
+   any arena that is left with no blocks in use. */
+static void
+put_blocks (struct desc *d, struct block **blocks, size_t cnt)
+{
+  adaptive_lock_acquire (&d->lock);
+  return_blocks (d, blocks, cnt);
+  adaptive_lock_release (&d->lock);
+}
+
+/* Does the work of put_blocks(), and returns the number of
+   arenas freed.  D's lock must be held. */
+static size_t
+return_blocks (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t freed = 0;
+  size_t i;
+
+  ASSERT (adaptive_lock_held_by_current_thread (&d->lock));
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = blocks[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena) 
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (j = 0; j < d->blocks_per_arena; j++) 
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          d->arena_cnt--;
+          palloc_free_page (a);
+          freed++;
+        }
+    }
+  return freed;
+}
+
+/* Puts the blocks in the running CPU's magazines back on their
+   descriptors' free lists, until PAGE_CNT arenas have been freed
+   as a result, and returns the number freed.  Skips descriptors
+   whose lock is busy. */
+static size_t
+shrink_magazines (size_t page_cnt)
+{
+  size_t freed = 0;
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt && freed < page_cnt; d++)
+    {
+      struct block *blocks[MAG_SIZE];
+      struct magazine *m;
+      enum intr_level old_level;
+      size_t cnt;
+
+      if (adaptive_lock_held_by_current_thread (&d->lock)
+          || !adaptive_lock_try_acquire (&d->lock))
+        continue;
+
+      old_level = intr_disable ();
+      m = get_magazine (d);
+      cnt = m->cnt;
+      memcpy (blocks, m->blocks, cnt * sizeof *blocks);
+      m->cnt = 0;
+      intr_set_level (old_level);
+
+      freed += return_blocks (d, blocks, cnt);
+      adaptive_lock_release (&d->lock);
+    }
+  return freed;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -292,3 +684,119 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+/* Counts an allocation of SIZE bytes, given a block of GOT bytes
+   in size class CLASS, on the running CPU. */
+static void
+count_alloc (size_t class, size_t size, size_t got) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct class_stats *s = &stats[cpu_current ()->id][class];
+
+  s->alloc_cnt++;
+  s->req_bytes += size;
+  s->got_bytes += got;
+  intr_set_level (old_level);
+}
+
+/* Counts freeing a block of FREED bytes in size class CLASS on
+   the running CPU. */
+static void
+count_free (size_t class, size_t freed) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct class_stats *s = &stats[cpu_current ()->id][class];
+
+  s->free_cnt++;
+  s->freed_bytes += freed;
+  intr_set_level (old_level);
+}
+
+/* Counts resizing a block in size class CLASS in place, from
+   OLD_SIZE to NEW_SIZE bytes to hold REQ_SIZE bytes, on the
+   running CPU.  The bytes count as if the block were freed and
+   allocated again, as they would be if it moved, but the blocks
+   do not. */
+static void
+count_resize (size_t class, size_t old_size, size_t new_size,
+              size_t req_size) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct class_stats *s = &stats[cpu_current ()->id][class];
+
+  s->freed_bytes += old_size;
+  s->got_bytes += new_size;
+  s->req_bytes += req_size;
+  intr_set_level (old_level);
+}
+
+/* Returns the word at the end of BLOCK that holds its call
+   site's index in the table. */
+static unsigned *
+site_idx (void *block) 
+{
+  return (unsigned *) ((uint8_t *) block + block_size (block)) - 1;
+}
+
+/* Records that CALLER allocated BLOCK. */
+static void
+track_alloc (void *block, const void *caller) 
+{
+  size_t h = ((uintptr_t) caller >> 2) % SITE_CNT;
+  size_t i;
+
+  adaptive_lock_acquire (&site_lock);
+  for (i = 0; i < SITE_CNT; i++)
+    {
+      size_t idx = (h + i) % SITE_CNT;
+      struct site *s = &sites[idx];
+
+      if (s->caller == NULL)
+        s->caller = caller;
+      if (s->caller == caller)
+        {
+          s->alloc_cnt++;
+          s->live_bytes += block_size (block) - sizeof (unsigned);
+          *site_idx (block) = idx;
+          break;
+        }
+    }
+  if (i == SITE_CNT)
+    {
+      *site_idx (block) = SITE_CNT;
+      untracked_cnt++;
+    }
+  adaptive_lock_release (&site_lock);
+}
+
+/* Records that BLOCK, allocated with tracking, is being freed. */
+static void
+track_free (void *block) 
+{
+  unsigned idx = *site_idx (block);
+
+  ASSERT (idx <= SITE_CNT);
+  if (idx == SITE_CNT)
+    return;
+
+  adaptive_lock_acquire (&site_lock);
+  sites[idx].free_cnt++;
+  sites[idx].live_bytes -= block_size (block) - sizeof (unsigned);
+  adaptive_lock_release (&site_lock);
+}
+
+/* Records that BLOCK, allocated with tracking at call site index
+   SITE, was resized in place from OLD_SIZE bytes, and moves the
+   index to its new end. */
+static void
+track_resize (void *block, unsigned site, size_t old_size) 
+{
+  *site_idx (block) = site;
+  if (site == SITE_CNT)
+    return;
+
+  adaptive_lock_acquire (&site_lock);
+  sites[site].live_bytes += block_size (block);
+  sites[site].live_bytes -= old_size;
+  adaptive_lock_release (&site_lock);
+}
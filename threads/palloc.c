@@ -1,14 +1,17 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/shrinker.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -16,22 +19,111 @@
    page-multiple) chunks.  See malloc.h for an allocator that
    hands out smaller chunks.
 
-   System memory is divided into two "pools" called the kernel
-   and user pools.  The user pool is for user (virtual) memory
-   pages, the kernel pool for everything else.  The idea here is
-   that the kernel needs to have memory for its own operations
-   even if user processes are swapping like mad.
+   Pages are handed out from two "pools" called the kernel and
+   user pools.  The user pool is for user (virtual) memory pages,
+   the kernel pool for everything else.  The idea here is that
+   the kernel needs to have memory for its own operations even
+   if user processes are swapping like mad.
 
-   By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   Both pools draw on the same free memory, but each has a soft
+   quota, by default half of it, capped for the user pool by
+   user_page_limit.  A pool may always use pages up to its quota.
+   Beyond that it may borrow free pages, as long as it leaves the
+   other pool a cushion of its unused quota, up to an eighth of
+   its quota.  When a pool below its quota finds no free pages,
+   it asks the other pool's reclaim function, if any, to give back
+   the pages it borrowed, and tries again if it gave any back at
+   once.  If that does not help
+   the kernel pool, it runs the shrinkers, which free memory that
+   kernel caches can do without: see shrinker.c.
+
+   Free memory is managed by a binary buddy allocator.  Every
+   free page belongs to exactly one free "block" of 2**ORDER
+   pages, for some ORDER, whose first page index is a multiple of
+   2**ORDER.  We keep a list of the free blocks of each order.
+
+   To allocate N pages, we take a free block of the smallest
+   order that is at least N pages, splitting a larger block in
+   halves as many times as needed, and give back the pages past
+   the first N.  To free pages, we split them into blocks the
+   same way and merge each block with its "buddy", the other
+   half of the block of the next order up, for as long as the
+   buddy is free too.  Both take O(log n) time in the amount of
+   memory.
+
+   Most allocations are for a single page, so each CPU also keeps
+   a small stack of "hot" pages per pool, freed recently enough
+   that they are likely still in its cache.  Single pages are
+   taken from and freed to it with interrupts off instead of the
+   allocator lock.  Only when it is empty, or full, do we take
+   the lock, to move HOT_BATCH pages between it and the free
+   lists at once.  A hot page still counts as in use by its pool.
+
+   When its CPU has nothing else to do, the idle thread moves hot
+   pages to a second stack of pages that it has already zeroed,
+   so that a PAL_ZERO request for a single page usually does not
+   have to zero one itself.  Other requests use zeroed pages only
+   when there are no others. */
+
+/* Number of block orders. */
+#define ORDER_CNT 16
+
+/* Per-page allocator state, kept in an array at the start of
+   free memory. */
+struct page_info
+  {
+    struct list_elem elem;              /* Element in a free list. */
+    int order;                          /* Order of free block, or -1. */
+    struct pool *pool;                  /* Owning pool, if in use. */
+  };
+
+/* Free memory. */
+struct buddy
+  {
+    struct adaptive_lock lock;          /* Protects buddy and pools. */
+    struct page_info *pages;            /* Per-page state. */
+    size_t page_cnt;                    /* Number of pages. */
+    size_t free_cnt;                    /* Number of free pages. */
+    size_t low_cnt;                     /* Minimum value of free_cnt. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks by order. */
+    size_t block_cnt[ORDER_CNT];        /* Number of blocks in each list. */
+    uint8_t *base;                      /* First page. */
+  };
+
+static struct buddy buddy;
+
+/* A CPU's hot pages in one pool.  May only be touched by its
+   own CPU with interrupts off. */
+#define HOT_MAX 16              /* Pages a stack holds. */
+#define HOT_BATCH (HOT_MAX / 2) /* Pages moved to or from the pool. */
+#define ZEROED_MAX 16           /* Zeroed pages a CPU keeps. */
+struct hot_pages
+  {
+    size_t cnt;                 /* Number of pages. */
+    void *pages[HOT_MAX];       /* Pages, most recently freed last. */
+    size_t zeroed_cnt;          /* Number of zeroed pages. */
+    void *zeroed[ZEROED_MAX];   /* Pages zeroed by the idle thread. */
+    long long hit_cnt;          /* # of pages taken from either stack. */
+    long long miss_cnt;         /* # of times both were empty. */
+    long long zero_cnt;         /* # of pages zeroed while idle. */
+    long long zero_hit_cnt;     /* # of PAL_ZERO pages served zeroed. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for reports. */
+    size_t quota;                       /* Pages it may always use. */
+    size_t limit;                       /* Pages it may never exceed. */
+    palloc_reclaim_func *reclaim;       /* Gives back borrowed pages. */
+    struct hot_pages hot[CPU_MAX];      /* Hot pages, by CPU. */
+
+    /* Protected by buddy.lock. */
+    size_t used_cnt;                    /* Pages in use, including hot. */
+    size_t peak_cnt;                    /* Maximum value of used_cnt. */
+    long long reclaim_cnt;              /* # of calls to reclaim. */
+    long long reclaimed_cnt;            /* # of pages they gave back. */
+    long long fail_cnt;                 /* # of requests refused. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,9 +132,24 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+static void init_buddy (void *base, size_t page_cnt);
+static void init_pool (struct pool *, const char *name, size_t quota,
+                       size_t limit);
+static struct pool *other_pool (struct pool *);
+static bool may_take (struct pool *, size_t page_cnt);
+static void *take_pages (struct pool *, size_t page_cnt);
+static bool reclaim (struct pool *, size_t page_cnt);
+static bool shrink (struct pool *, size_t page_cnt);
+static void remove_block (size_t page_idx);
+static size_t take_block (int order);
+static size_t free_block_at (size_t page_idx);
+static void free_range (size_t page_idx, size_t page_cnt);
+static void print_buddy (void);
+static struct hot_pages *hot_pages (struct pool *);
+static void *get_hot_page (struct pool *, bool zero, bool *zeroed);
+static void put_hot_page (struct pool *, void *page);
+static void drain_hot_pages (struct pool *);
+static void put_pages (struct pool *, void **pages, size_t cnt);
 
 /* Initializes the page allocator. */
 void
@@ -55,17 +162,38 @@ palloc_init (void)
   /* Free memory. */
   uint8_t *free_start = pg_round_up (&_end);
   uint8_t *free_end = ptov (ram_pages * PGSIZE);
-  size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
-  if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  size_t user_quota;
+
+  init_buddy (free_start, (free_end - free_start) / PGSIZE);
 
   /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  user_quota = buddy.page_cnt / 2;
+  if (user_quota > user_page_limit)
+    user_quota = user_page_limit;
+  init_pool (&kernel_pool, "kernel pool", buddy.page_cnt - user_quota,
+             SIZE_MAX);
+  init_pool (&user_pool, "user pool", user_quota, user_page_limit);
+}
+
+/* Sets the function that the pool named by FLAGS, the user pool
+   if PAL_USER is set and otherwise the kernel pool, calls to
+   give back pages it has borrowed.  See palloc_reclaim_func. */
+void
+palloc_set_reclaim (enum palloc_flags flags, palloc_reclaim_func *func) 
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+
+  pool->reclaim = func;
+}
+
+/* Moves the running CPU's hot pages in the pool named by FLAGS,
+   the user pool if PAL_USER is set and otherwise the kernel
+   pool, on to free memory, so that the other pool can borrow
+   them.  For a reclaim function that frees pages later. */
+void
+palloc_flush (enum palloc_flags flags) 
+{
+  drain_hot_pages (flags & PAL_USER ? &user_pool : &kernel_pool);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -78,30 +206,38 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
-  size_t page_idx;
+  void *pages = NULL;
+  bool zeroed = false;
 
   if (page_cnt == 0)
     return NULL;
-
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  else if (page_cnt == 1)
+    pages = get_hot_page (pool, flags & PAL_ZERO, &zeroed);
   else
-    pages = NULL;
+    {
+      pages = take_pages (pool, page_cnt);
+
+      /* If there is no block big enough, our hot pages might be
+         what is missing, so give them back and try again. */
+      if (pages == NULL)
+        {
+          drain_hot_pages (pool);
+          pages = take_pages (pool, page_cnt);
+        }
+    }
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && !zeroed)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
+      adaptive_lock_acquire (&buddy.lock);
+      pool->fail_cnt++;
+      adaptive_lock_release (&buddy.lock);
     }
 
   return pages;
@@ -125,27 +261,36 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
-  size_t page_idx;
+  size_t page_idx, i;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
-
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT ((uint8_t *) pages >= buddy.base);
+  page_idx = pg_no (pages) - pg_no (buddy.base);
+  ASSERT (page_idx + page_cnt <= buddy.page_cnt);
+  pool = buddy.pages[page_idx].pool;
+  ASSERT (pool == &kernel_pool || pool == &user_pool);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (page_cnt == 1)
+    put_hot_page (pool, pages);
+  else
+    {
+      adaptive_lock_acquire (&buddy.lock);
+      for (i = 0; i < page_cnt; i++)
+        {
+          ASSERT (buddy.pages[page_idx + i].pool == pool);
+          buddy.pages[page_idx + i].pool = NULL;
+        }
+      free_range (page_idx, page_cnt);
+      pool->used_cnt -= page_cnt;
+      adaptive_lock_release (&buddy.lock);
+    }
 }
 
 /* Frees the page at PAGE. */
@@ -155,35 +300,595 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Tries to grow the PAGE_CNT pages at PAGES, which were obtained
+   with palloc_get_multiple(), to NEW_CNT pages, by taking the
+   pages that follow them.  Returns true if successful.  Returns
+   false, changing nothing, if those pages are not all free or
+   the pages' pool may not have them. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  struct pool *pool;
+  size_t page_idx, end, idx, i;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (page_cnt > 0 && new_cnt >= page_cnt);
+  ASSERT ((uint8_t *) pages >= buddy.base);
+
+  page_idx = pg_no (pages) - pg_no (buddy.base);
+  pool = buddy.pages[page_idx].pool;
+  ASSERT (pool == &kernel_pool || pool == &user_pool);
+  if (new_cnt == page_cnt)
+    return true;
+  if (page_idx + new_cnt > buddy.page_cnt)
+    return false;
+  end = page_idx + new_cnt;
+
+  adaptive_lock_acquire (&buddy.lock);
+  if (!may_take (pool, new_cnt - page_cnt))
+    goto done;
+
+  /* Check that the pages are all free.  Each free block that
+     holds them starts right where the previous one ends, because
+     the pages before it are in use. */
+  for (idx = page_idx + page_cnt; idx < end;
+       idx += (size_t) 1 << buddy.pages[idx].order)
+    if (free_block_at (idx) != idx)
+      goto done;
+
+  /* Take those blocks, and give back whatever of the last one we
+     do not need. */
+  for (idx = page_idx + page_cnt; idx < end; )
+    {
+      size_t block_end = idx + ((size_t) 1 << buddy.pages[idx].order);
+
+      remove_block (idx);
+      if (block_end > end)
+        free_range (end, block_end - end);
+      idx = block_end;
+    }
+
+  for (i = page_idx + page_cnt; i < end; i++)
+    buddy.pages[i].pool = pool;
+  pool->used_cnt += new_cnt - page_cnt;
+  if (pool->used_cnt > pool->peak_cnt)
+    pool->peak_cnt = pool->used_cnt;
+  success = true;
+
+ done:
+  adaptive_lock_release (&buddy.lock);
+  return success;
+}
+
+/* Zeroes one of the running CPU's hot pages in one of the pools
+   and moves it to the zeroed pages.  Returns true if it did, or
+   false if there was nothing to do.
+
+   Called by the idle thread, with interrupts off, when its CPU
+   has nothing else to run.  Interrupts are turned on while the
+   page is zeroed, so that anything that becomes ready can
+   preempt it, and are off again on return. */
+bool
+palloc_zero_idle (void) 
+{
+  struct pool *pools[] = { &kernel_pool, &user_pool };
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct hot_pages *h = hot_pages (pools[i]);
+      void *page;
+
+      if (h->cnt == 0 || h->zeroed_cnt >= ZEROED_MAX)
+        continue;
+      page = h->pages[--h->cnt];
+
+      intr_enable ();
+      memset (page, 0, PGSIZE);
+      intr_disable ();
+
+      /* Only this CPU's idle thread adds zeroed pages, and it
+         never moves to another CPU, so there is still room. */
+      h = hot_pages (pools[i]);
+      ASSERT (h->zeroed_cnt < ZEROED_MAX);
+      h->zeroed[h->zeroed_cnt++] = page;
+      h->zero_cnt++;
+      return true;
+    }
+  return false;
+}
+
+/* Prints a report on the fragmentation of free memory and on
+   each pool's use of memory and of its hot pages. */
+void
+palloc_print_stats (void) 
+{
+  struct pool *pools[] = { &kernel_pool, &user_pool };
+  size_t i;
+
+  print_buddy ();
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      long long hits = 0, misses = 0, zeroed = 0, zero_hits = 0;
+      int cpu;
+
+      printf ("%s: %zu pages in use (peak %zu), quota %zu, "
+              "%lld requests refused, "
+              "%lld reclaims gave back %lld pages\n",
+              pool->name, pool->used_cnt, pool->peak_cnt, pool->quota,
+              pool->fail_cnt, pool->reclaim_cnt, pool->reclaimed_cnt);
+      for (cpu = 0; cpu < CPU_MAX; cpu++)
+        {
+          hits += pool->hot[cpu].hit_cnt;
+          misses += pool->hot[cpu].miss_cnt;
+          zeroed += pool->hot[cpu].zero_cnt;
+          zero_hits += pool->hot[cpu].zero_hit_cnt;
+        }
+      if (hits + misses > 0)
+        printf ("%s: %lld hot page hits, %lld misses (%lld%% hits)\n",
+                pool->name, hits, misses, hits * 100 / (hits + misses));
+      if (zeroed > 0)
+        printf ("%s: %lld pages zeroed while idle, %lld used by PAL_ZERO\n",
+                pool->name, zeroed, zero_hits);
+    }
+}
+
+/* Initializes the buddy allocator with the PAGE_CNT pages at
+   BASE. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_buddy (void *base, size_t page_cnt) 
+{
+  /* We'll put the page_info array at the base.
+     Calculate the space needed for the array
+     and subtract it from the number of pages. */
+  size_t info_pages = DIV_ROUND_UP (page_cnt * sizeof *buddy.pages, PGSIZE);
+  size_t i;
+  int order;
+
+  if (info_pages > page_cnt)
+    PANIC ("Not enough memory for page array.");
+  page_cnt -= info_pages;
+
+  adaptive_lock_init (&buddy.lock, "palloc");
+  buddy.pages = base;
+  buddy.page_cnt = page_cnt;
+  buddy.free_cnt = 0;
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      list_init (&buddy.free_lists[order]);
+      buddy.block_cnt[order] = 0;
+    }
+  buddy.base = (uint8_t *) base + info_pages * PGSIZE;
+
+  /* Free all the pages. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      buddy.pages[i].order = -1;
+      buddy.pages[i].pool = NULL;
+    }
+  free_range (0, page_cnt);
+  buddy.low_cnt = buddy.free_cnt;
+  print_buddy ();
+}
+
+/* Initializes pool P, naming it NAME, with the given QUOTA and
+   hard LIMIT. */
+static void
+init_pool (struct pool *p, const char *name, size_t quota, size_t limit) 
+{
+  printf ("%zu pages available in %s.\n", quota, name);
+
+  p->name = name;
+  p->quota = quota;
+  p->limit = limit;
+  p->reclaim = NULL;
+  memset (p->hot, 0, sizeof p->hot);
+  p->used_cnt = p->peak_cnt = 0;
+  p->reclaim_cnt = p->reclaimed_cnt = 0;
+  p->fail_cnt = 0;
+}
+
+/* Returns the pool other than POOL. */
+static struct pool *
+other_pool (struct pool *pool) 
+{
+  return pool == &kernel_pool ? &user_pool : &kernel_pool;
+}
+
+/* Returns true if POOL may take PAGE_CNT more pages from free
+   memory, either within its quota or by borrowing.  The
+   allocator lock must be held. */
+static bool
+may_take (struct pool *pool, size_t page_cnt) 
+{
+  struct pool *other = other_pool (pool);
+  size_t cushion;
+
+  ASSERT (adaptive_lock_held_by_current_thread (&buddy.lock));
+
+  if (pool->used_cnt + page_cnt > pool->limit)
+    return false;
+  if (pool->used_cnt + page_cnt <= pool->quota)
+    return true;
+
+  /* Borrow, but leave the other pool room to grow. */
+  cushion = other->used_cnt < other->quota ? other->quota - other->used_cnt : 0;
+  if (cushion > other->quota / 8)
+    cushion = other->quota / 8;
+  return buddy.free_cnt >= page_cnt + cushion;
+}
+
+/* Takes PAGE_CNT contiguous pages from free memory for POOL and
+   returns the first, or a null pointer if POOL may not have them
+   or they are not available even after reclaiming borrowed
+   pages from the other pool and running the shrinkers. */
+static void *
+take_pages (struct pool *pool, size_t page_cnt) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  int order;
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  /* Smallest order with at least PAGE_CNT pages. */
+  for (order = 0; order < ORDER_CNT; order++)
+    if (((size_t) 1 << order) >= page_cnt)
+      break;
+  if (order == ORDER_CNT)
+    return NULL;
+
+  do
+    {
+      size_t page_idx = SIZE_MAX;
+      size_t i;
+
+      adaptive_lock_acquire (&buddy.lock);
+      if (may_take (pool, page_cnt))
+        page_idx = take_block (order);
+      if (page_idx != SIZE_MAX)
+        {
+          /* Give back the pages we do not need. */
+          free_range (page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+          for (i = 0; i < page_cnt; i++)
+            buddy.pages[page_idx + i].pool = pool;
+          pool->used_cnt += page_cnt;
+          if (pool->used_cnt > pool->peak_cnt)
+            pool->peak_cnt = pool->used_cnt;
+        }
+      adaptive_lock_release (&buddy.lock);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+      if (page_idx != SIZE_MAX)
+        return buddy.base + PGSIZE * page_idx;
+    }
+  while (reclaim (pool, page_cnt) || shrink (pool, page_cnt));
+  return NULL;
 }
 
-/* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
+/* Asks the pool other than POOL to give back up to PAGE_CNT
+   borrowed pages, or HOT_BATCH if that is more, if POOL is below
+   its quota and the other pool is above its own.  Returns true
+   if any pages were given back. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+reclaim (struct pool *pool, size_t page_cnt) 
+{
+  struct pool *other = other_pool (pool);
+  size_t want, got;
+
+  adaptive_lock_acquire (&buddy.lock);
+  if (pool->used_cnt < pool->quota && other->used_cnt > other->quota
+      && other->reclaim != NULL)
+    {
+      want = other->used_cnt - other->quota;
+      if (want > page_cnt && want > HOT_BATCH)
+        want = page_cnt > HOT_BATCH ? page_cnt : HOT_BATCH;
+    }
+  else
+    want = 0;
+  adaptive_lock_release (&buddy.lock);
+  if (want == 0)
+    return false;
+
+  /* Pages freed one at a time land in our CPU's hot pages, so
+     move them on to free memory. */
+  got = other->reclaim (want);
+  drain_hot_pages (other);
+
+  adaptive_lock_acquire (&buddy.lock);
+  other->reclaim_cnt++;
+  other->reclaimed_cnt += got;
+  adaptive_lock_release (&buddy.lock);
+  return got > 0;
+}
+
+/* Runs the shrinkers to free up to PAGE_CNT pages, or HOT_BATCH
+   if that is more, if POOL is the kernel pool.  Returns true if
+   any pages were freed. */
+static bool
+shrink (struct pool *pool, size_t page_cnt) 
+{
+  size_t got;
+
+  if (pool != &kernel_pool)
+    return false;
+
+  /* As in reclaim(), move pages freed one at a time on to free
+     memory. */
+  got = shrinker_run (page_cnt > HOT_BATCH ? page_cnt : HOT_BATCH);
+  drain_hot_pages (pool);
+  return got > 0;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to the free
+   lists. */
+static void
+push_block (size_t page_idx, int order) 
+{
+  buddy.pages[page_idx].order = order;
+  list_push_front (&buddy.free_lists[order], &buddy.pages[page_idx].elem);
+  buddy.block_cnt[order]++;
+  buddy.free_cnt += (size_t) 1 << order;
+}
+
+/* Removes the free block at PAGE_IDX from the free lists. */
+static void
+remove_block (size_t page_idx) 
+{
+  int order = buddy.pages[page_idx].order;
+
+  ASSERT (order >= 0);
+  buddy.pages[page_idx].order = -1;
+  list_remove (&buddy.pages[page_idx].elem);
+  buddy.block_cnt[order]--;
+  buddy.free_cnt -= (size_t) 1 << order;
+  if (buddy.free_cnt < buddy.low_cnt)
+    buddy.low_cnt = buddy.free_cnt;
+}
+
+/* Takes a free block of 2**ORDER pages, splitting a larger one
+   if necessary, and returns the index of its first page, or
+   SIZE_MAX if there is none.  The allocator lock must be
+   held. */
+static size_t
+take_block (int order) 
+{
+  size_t page_idx;
+  int o;
+
+  for (o = order; o < ORDER_CNT; o++)
+    if (!list_empty (&buddy.free_lists[o]))
+      break;
+  if (o == ORDER_CNT)
+    return SIZE_MAX;
+
+  page_idx = list_entry (list_front (&buddy.free_lists[o]),
+                         struct page_info, elem) - buddy.pages;
+  remove_block (page_idx);
+
+  /* Free the upper half until the block is the right size. */
+  while (o > order)
+    {
+      o--;
+      push_block (page_idx + ((size_t) 1 << o), o);
+    }
+  return page_idx;
+}
+
+/* Returns the index of the first page of the free block that
+   holds page PAGE_IDX, or SIZE_MAX if that page is not free.
+   The allocator lock must be held. */
+static size_t
+free_block_at (size_t page_idx) 
+{
+  int order;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      size_t head = page_idx & ~(((size_t) 1 << order) - 1);
+      if (buddy.pages[head].order == order)
+        return head;
+    }
+  return SIZE_MAX;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX, merging it with
+   its buddy for as long as the buddy is free.  The allocator
+   lock must be held. */
+static void
+free_block (size_t page_idx, int order) 
+{
+  while (order + 1 < ORDER_CNT)
+    {
+      size_t other = page_idx ^ ((size_t) 1 << order);
+      if (other >= buddy.page_cnt || buddy.pages[other].order != order)
+        break;
+      remove_block (other);
+      page_idx &= ~((size_t) 1 << order);
+      order++;
+    }
+  push_block (page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX, as the largest aligned
+   blocks that cover them.  The allocator lock must be held,
+   except during initialization. */
+static void
+free_range (size_t page_idx, size_t page_cnt) 
 {
-  size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  while (page_cnt > 0)
+    {
+      int order = 0;
 
-  return page_no >= start_page && page_no < end_page;
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Prints how fragmented free memory is: the number of free
+   pages and the fewest there have been, the largest free block,
+   and the number of free blocks of each order. */
+static void
+print_buddy (void) 
+{
+  int order, top;
+
+  for (top = ORDER_CNT - 1; top > 0; top--)
+    if (buddy.block_cnt[top] > 0)
+      break;
+
+  printf ("Free memory: %zu of %zu pages free (low %zu), "
+          "largest block %zu pages, blocks by order:",
+          buddy.free_cnt, buddy.page_cnt, buddy.low_cnt,
+          buddy.block_cnt[top] > 0 ? (size_t) 1 << top : 0);
+  for (order = 0; order <= top; order++)
+    printf (" %zu", buddy.block_cnt[order]);
+  printf ("\n");
+}
+
+/* Returns the running CPU's hot pages in POOL.  Interrupts must
+   be off. */
+static struct hot_pages *
+hot_pages (struct pool *pool) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return &pool->hot[cpu_current ()->id];
+}
+
+/* Takes a page from the running CPU's hot pages in POOL, first
+   refilling them with up to HOT_BATCH pages from free memory if
+   they are empty.  If ZERO is true, prefers a page that is
+   already zeroed.  Sets *ZEROED to true if the page returned is
+   zeroed.  Returns a null pointer if POOL can get no pages. */
+static void *
+get_hot_page (struct pool *pool, bool zero, bool *zeroed) 
+{
+  void *batch[HOT_BATCH];
+  struct hot_pages *h;
+  enum intr_level old_level;
+  void *page = NULL;
+  size_t cnt, i;
+
+  old_level = intr_disable ();
+  h = hot_pages (pool);
+  if (h->zeroed_cnt > 0 && (zero || h->cnt == 0))
+    {
+      page = h->zeroed[--h->zeroed_cnt];
+      *zeroed = true;
+      h->hit_cnt++;
+      if (zero)
+        h->zero_hit_cnt++;
+    }
+  else if (h->cnt > 0)
+    {
+      page = h->pages[--h->cnt];
+      h->hit_cnt++;
+    }
+  else
+    h->miss_cnt++;
+  intr_set_level (old_level);
+  if (page != NULL)
+    return page;
+
+  adaptive_lock_acquire (&buddy.lock);
+  for (cnt = 0; cnt < HOT_BATCH && may_take (pool, 1); cnt++)
+    {
+      size_t page_idx = take_block (0);
+      if (page_idx == SIZE_MAX)
+        break;
+      buddy.pages[page_idx].pool = pool;
+      batch[cnt] = buddy.base + PGSIZE * page_idx;
+    }
+  pool->used_cnt += cnt;
+  if (pool->used_cnt > pool->peak_cnt)
+    pool->peak_cnt = pool->used_cnt;
+  adaptive_lock_release (&buddy.lock);
+  if (cnt == 0)
+    return take_pages (pool, 1);
+
+  /* We may have moved to another CPU, or another thread may have
+     filled the stack, while we held the lock.  Whatever does not
+     fit goes back. */
+  old_level = intr_disable ();
+  h = hot_pages (pool);
+  for (i = 1; i < cnt && h->cnt < HOT_MAX; i++)
+    h->pages[h->cnt++] = batch[i];
+  intr_set_level (old_level);
+  if (i < cnt)
+    put_pages (pool, batch + i, cnt - i);
+
+  return batch[0];
+}
+
+/* Puts PAGE on the running CPU's hot pages in POOL, first giving
+   the oldest HOT_BATCH of them back to free memory if they are
+   full. */
+static void
+put_hot_page (struct pool *pool, void *page) 
+{
+  void *batch[HOT_BATCH];
+  struct hot_pages *h;
+  enum intr_level old_level;
+  bool drain;
+
+  old_level = intr_disable ();
+  h = hot_pages (pool);
+  drain = h->cnt == HOT_MAX;
+  if (drain)
+    {
+      memcpy (batch, h->pages, sizeof batch);
+      memmove (h->pages, h->pages + HOT_BATCH,
+               (HOT_MAX - HOT_BATCH) * sizeof *h->pages);
+      h->cnt -= HOT_BATCH;
+    }
+  h->pages[h->cnt++] = page;
+  intr_set_level (old_level);
+
+  if (drain)
+    put_pages (pool, batch, HOT_BATCH);
+}
+
+/* Gives all of the running CPU's hot and zeroed pages in POOL
+   back to free memory. */
+static void
+drain_hot_pages (struct pool *pool) 
+{
+  void *batch[HOT_MAX + ZEROED_MAX];
+  struct hot_pages *h;
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  h = hot_pages (pool);
+  memcpy (batch, h->pages, h->cnt * sizeof *batch);
+  memcpy (batch + h->cnt, h->zeroed, h->zeroed_cnt * sizeof *batch);
+  cnt = h->cnt + h->zeroed_cnt;
+  h->cnt = h->zeroed_cnt = 0;
+  intr_set_level (old_level);
+
+  put_pages (pool, batch, cnt);
+}
+
+/* Frees the CNT single pages in PAGES, which belong to POOL, to
+   free memory. */
+static void
+put_pages (struct pool *pool, void **pages, size_t cnt) 
+{
+  size_t i;
+
+  adaptive_lock_acquire (&buddy.lock);
+  for (i = 0; i < cnt; i++)
+    {
+      size_t page_idx = pg_no (pages[i]) - pg_no (buddy.base);
+
+      ASSERT (buddy.pages[page_idx].pool == pool);
+      buddy.pages[page_idx].pool = NULL;
+      free_block (page_idx, 0);
+    }
+  pool->used_cnt -= cnt;
+  adaptive_lock_release (&buddy.lock);
 }
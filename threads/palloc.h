@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -14,10 +15,23 @@ enum palloc_flags
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* Makes a pool give back up to PAGE_CNT pages that it borrowed
+   beyond its quota, by freeing pages it holds, and returns the
+   number of pages freed.  Called by a thread whose allocation
+   from the other pool failed, which may hold any lock, so it
+   must not block: it may instead arrange for the pages to be
+   freed later, e.g. on a worker thread, and return 0. */
+typedef size_t palloc_reclaim_func (size_t page_cnt);
+
 void palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_cnt);
+void palloc_set_reclaim (enum palloc_flags, palloc_reclaim_func *);
+void palloc_flush (enum palloc_flags);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,130 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.
+
+   With profile_enabled set, the timer interrupt handler calls
+   profile_sample() on every tick, which records the interrupted
+   instruction and thread in the current CPU's ring buffer.  When
+   a ring fills up, the oldest samples are overwritten.  Code
+   that runs with interrupts off is never sampled; use
+   "-intr-prof" to find it.
+
+   The "dump-profile FILE" action writes the samples to a file,
+   which utils/pintos-prof turns into a profile. */
+bool profile_enabled;
+
+/* Pages of samples per CPU. */
+#define PROFILE_PAGES 8
+
+/* Samples per CPU. */
+#define PROFILE_SAMPLES \
+  (PROFILE_PAGES * PGSIZE / sizeof (struct profile_sample))
+
+/* A CPU's samples.  Only that CPU writes to it, from its timer
+   interrupt. */
+struct profile_ring
+  {
+    struct profile_sample *samples; /* PROFILE_SAMPLES entries. */
+    unsigned long long taken;   /* # of samples ever taken. */
+  };
+
+static struct profile_ring rings[CPU_MAX];
+
+/* Allocates a ring buffer for each CPU.  Sampling starts as soon
+   as this returns. */
+void
+profile_init (void)
+{
+  int i;
+
+  if (!profile_enabled)
+    return;
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      rings[i].samples = palloc_get_multiple (0, PROFILE_PAGES);
+      if (rings[i].samples == NULL)
+        PANIC ("profile: out of memory for samples");
+    }
+}
+
+/* Records a sample of the code interrupted at F.  Called from
+   the timer interrupt handler. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  struct cpu *c = t->cpu;
+  struct profile_ring *r = &rings[c->id];
+  struct profile_sample *s;
+
+  ASSERT (intr_context ());
+
+  if (!profile_enabled || r->samples == NULL)
+    return;
+  s = &r->samples[r->taken++ % PROFILE_SAMPLES];
+  s->eip = (uint32_t) f->eip;
+  s->tid = t->tid;
+  s->flags = 0;
+  if ((f->cs & 3) == 3)
+    s->flags |= PROFILE_USER;
+  if (t == c->idle_thread)
+    s->flags |= PROFILE_IDLE;
+}
+
+/* Returns the number of samples held, over all CPUs. */
+size_t
+profile_sample_cnt (void)
+{
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++)
+    cnt += (rings[i].taken < PROFILE_SAMPLES
+            ? rings[i].taken : PROFILE_SAMPLES);
+  return cnt;
+}
+
+/* Copies the sample with index IDX, which must be less than
+   profile_sample_cnt(), into *S.  Samples are ordered by CPU,
+   then oldest first.  Sampling should be stopped while the
+   samples are read. */
+void
+profile_get (size_t idx, struct profile_sample *s)
+{
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      struct profile_ring *r = &rings[i];
+      size_t cnt = r->taken < PROFILE_SAMPLES ? r->taken : PROFILE_SAMPLES;
+      if (idx < cnt)
+        {
+          *s = r->samples[(r->taken - cnt + idx) % PROFILE_SAMPLES];
+          return;
+        }
+      idx -= cnt;
+    }
+  NOT_REACHED ();
+}
+
+/* Prints profiler statistics. */
+void
+profile_print_stats (void)
+{
+  unsigned long long taken = 0;
+  int i;
+
+  if (!profile_enabled)
+    return;
+  for (i = 0; i < CPU_MAX; i++)
+    taken += rings[i].taken;
+  printf ("Profile: %llu samples taken, %zu kept\n",
+          taken, profile_sample_cnt ());
+}
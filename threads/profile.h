@@ -0,0 +1,33 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct intr_frame;
+
+/* One profiler sample.  This is also the on-disk format written
+   by the "dump-profile" action, following a header of "PROF"
+   and a 32-bit sample count, all little-endian. */
+struct profile_sample
+  {
+    uint32_t eip;               /* Interrupted instruction. */
+    int32_t tid;                /* Running thread. */
+    uint32_t flags;             /* PROFILE_* flags. */
+  };
+
+#define PROFILE_USER 0x1        /* Sampled in user mode. */
+#define PROFILE_IDLE 0x2        /* Sampled in an idle thread. */
+
+/* Whether to take samples.  Controlled by kernel command-line
+   option "-profile". */
+extern bool profile_enabled;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+size_t profile_sample_cnt (void);
+void profile_get (size_t idx, struct profile_sample *);
+void profile_print_stats (void);
+
+#endif /* threads/profile.h */
@@ -0,0 +1,87 @@
+#include "threads/shrinker.h"
+#include <debug.h>
+#include <stdio.h>
+
+/* Shrinkers.
+
+   Kernel caches hold on to memory that they could give back:
+   spare pages and slabs kept to make the next allocation cheap,
+   blocks parked in per-CPU magazines, and so on.  Each such
+   cache registers a shrinker.  When the kernel pool runs out of
+   pages, the page allocator calls shrinker_run(), which asks the
+   shrinkers, lowest priority first, to free memory until enough
+   pages have been freed.  Only if they cannot does the
+   allocation fail. */
+
+/* Registered shrinkers, in order of priority.  Only changed
+   during initialization. */
+#define SHRINKER_MAX 16
+static struct shrinker *shrinkers[SHRINKER_MAX];
+static size_t shrinker_cnt;
+
+/* Initializes S as a shrinker called NAME, which must stay valid
+   for the life of the kernel, that frees memory by calling
+   SHRINK, and registers it to run at the given PRIORITY, after
+   any shrinkers already registered with the same priority.  Must
+   be called during initialization. */
+void
+shrinker_register (struct shrinker *s, const char *name, int priority,
+                   shrink_func *shrink)
+{
+  size_t i;
+
+  ASSERT (s != NULL);
+  ASSERT (shrink != NULL);
+  if (shrinker_cnt >= SHRINKER_MAX)
+    PANIC ("%s: too many shrinkers", name);
+
+  s->name = name;
+  s->priority = priority;
+  s->shrink = shrink;
+  spinlock_init (&s->lock);
+  s->run_cnt = s->freed_cnt = 0;
+
+  for (i = shrinker_cnt; i > 0 && shrinkers[i - 1]->priority > priority; i--)
+    shrinkers[i] = shrinkers[i - 1];
+  shrinkers[i] = s;
+  shrinker_cnt++;
+}
+
+/* Runs shrinkers, in order of priority, until they have freed
+   PAGE_CNT pages or all have run.  Returns the number of pages
+   freed.  Pages freed one at a time may end up in the running
+   CPU's hot pages instead of in free memory. */
+size_t
+shrinker_run (size_t page_cnt)
+{
+  size_t freed = 0;
+  size_t i;
+
+  for (i = 0; i < shrinker_cnt && freed < page_cnt; i++)
+    {
+      struct shrinker *s = shrinkers[i];
+      size_t cnt = s->shrink (page_cnt - freed);
+
+      spinlock_acquire (&s->lock);
+      s->run_cnt++;
+      s->freed_cnt += cnt;
+      spinlock_release (&s->lock);
+      freed += cnt;
+    }
+  return freed;
+}
+
+/* Prints statistics for each shrinker that has run. */
+void
+shrinker_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < shrinker_cnt; i++)
+    {
+      struct shrinker *s = shrinkers[i];
+      if (s->run_cnt > 0)
+        printf ("Shrinker %s: %llu runs freed %llu pages\n",
+                s->name, s->run_cnt, s->freed_cnt);
+    }
+}
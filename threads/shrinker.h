@@ -0,0 +1,34 @@
+#ifndef THREADS_SHRINKER_H
+#define THREADS_SHRINKER_H
+
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Frees up to PAGE_CNT pages of kernel memory that a cache holds
+   but can do without, and returns the number of pages freed.
+   Called by a thread whose kernel page allocation failed, which
+   may hold any lock, so it must not wait for one: it should skip
+   whatever it cannot lock with a "try" function. */
+typedef size_t shrink_func (size_t page_cnt);
+
+/* Shrinker priorities.  Lower priorities run first. */
+#define SHRINK_SPARE 0          /* Free memory kept in reserve. */
+#define SHRINK_CACHE 10         /* Memory that is costly to get back. */
+
+/* A shrinker.  See shrinker.c. */
+struct shrinker
+  {
+    const char *name;           /* Name, for statistics. */
+    int priority;               /* One of SHRINK_*. */
+    shrink_func *shrink;        /* Frees memory. */
+    struct spinlock lock;       /* Protects the members below. */
+    unsigned long long run_cnt; /* # of calls to shrink. */
+    unsigned long long freed_cnt; /* # of pages they freed. */
+  };
+
+void shrinker_register (struct shrinker *, const char *name, int priority,
+                        shrink_func *);
+size_t shrinker_run (size_t page_cnt);
+void shrinker_print_stats (void);
+
+#endif /* threads/shrinker.h */
@@ -0,0 +1,342 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/shrinker.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds each request up to a power of 2 and serves all
+   requests of similar size from one shared descriptor.  A kernel
+   object that is allocated and freed often does better in a
+   cache of its own, created with kmem_cache_create(), which
+   hands out objects of exactly one size.
+
+   A cache carves pages, called "slabs", into objects.  Each slab
+   starts with a header, followed by as many objects as fit, and
+   keeps its own list of free objects, so that a slab whose
+   objects are all free can be given back to the page allocator.
+   Slabs with some free objects are on the cache's partial list,
+   and allocation takes from the first of them; slabs with none
+   are on its full list.  One entirely free slab is kept in
+   reserve, so that a cache whose use goes back and forth across
+   a slab boundary does not allocate and free a page each time.
+
+   A free object links to the next with a pointer in its first
+   word.  If the cache has a constructor, the pointer goes in an
+   extra word after the object instead, so that objects keep the
+   state the constructor gave them while they are free.
+
+   Under memory pressure, a shrinker frees the spare slabs. */
+
+/* Cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Bytes in an object, as requested. */
+    size_t link_ofs;            /* Offset of free-list link in object. */
+    size_t stride;              /* Bytes between objects in a slab. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor *ctor;            /* Constructor, or a null pointer. */
+    struct adaptive_lock lock;  /* Protects the members below. */
+    struct list partial;        /* Slabs with some free objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct slab *spare;         /* A slab with no objects in use. */
+    size_t slab_cnt;            /* # of slabs, including spare. */
+    size_t in_use;              /* # of objects allocated. */
+    size_t peak;                /* Maximum value of in_use. */
+    unsigned long long alloc_cnt; /* # of objects ever allocated. */
+    unsigned long long free_cnt;  /* # of objects ever freed. */
+  };
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in partial or full list. */
+    void *free;                 /* First free object. */
+    size_t in_use;              /* # of objects allocated. */
+  };
+
+/* Every cache, for kmem_cache_print_stats(). */
+#define KMEM_CACHE_MAX 32
+static struct kmem_cache *caches[KMEM_CACHE_MAX];
+static size_t cache_cnt;
+
+/* Frees spare slabs under memory pressure. */
+static struct shrinker shrinker;
+
+static shrink_func shrink_spares;
+static struct slab *new_slab (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+static void **free_link (struct kmem_cache *, void *);
+
+/* Initializes object caches. */
+void
+kmem_cache_init (void)
+{
+  shrinker_register (&shrinker, "slab spares", SHRINK_SPARE, shrink_spares);
+}
+
+/* Creates and returns a cache of SIZE-byte objects called NAME,
+   which must stay valid for the life of the cache.  CTOR, if
+   nonnull, is called on each object when its slab is created,
+   and objects must be in the constructed state when freed.
+   Panics if memory is not available, because caches are created
+   only during initialization.  Must be called after
+   malloc_init(). */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor *ctor)
+{
+  struct kmem_cache *c;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("%s: out of memory for object cache", name);
+
+  c->name = name;
+  c->obj_size = size;
+  size = ROUND_UP (size, sizeof (void *));
+  c->link_ofs = ctor != NULL ? size : 0;
+  c->stride = ctor != NULL ? size + sizeof (void *) : size;
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->stride;
+  ASSERT (c->objs_per_slab > 0);
+  c->ctor = ctor;
+  adaptive_lock_init (&c->lock, name);
+  list_init (&c->partial);
+  list_init (&c->full);
+  c->spare = NULL;
+  c->slab_cnt = 0;
+  c->in_use = c->peak = 0;
+  c->alloc_cnt = c->free_cnt = 0;
+
+  if (cache_cnt < KMEM_CACHE_MAX)
+    caches[cache_cnt++] = c;
+  return c;
+}
+
+/* Allocates and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  ASSERT (c != NULL);
+
+  adaptive_lock_acquire (&c->lock);
+
+  /* Find a slab with a free object. */
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else
+    {
+      if (c->spare != NULL)
+        {
+          s = c->spare;
+          c->spare = NULL;
+        }
+      else
+        {
+          s = new_slab (c);
+          if (s == NULL)
+            {
+              adaptive_lock_release (&c->lock);
+              return NULL;
+            }
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  /* Take its first free object. */
+  obj = s->free;
+  s->free = *free_link (c, obj);
+  if (++s->in_use == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak)
+    c->peak = c->in_use;
+  adaptive_lock_release (&c->lock);
+  return obj;
+}
+
+/* Frees OBJ, which must have been allocated from cache C.  If
+   OBJ is null, does nothing. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (c, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it is meant to keep its constructed state. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->obj_size);
+#endif
+
+  adaptive_lock_acquire (&c->lock);
+
+  /* Put the object on its slab's free list. */
+  *free_link (c, obj) = s->free;
+  s->free = obj;
+  if (s->in_use-- == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  /* If the slab is now entirely free, keep it as the spare or
+     give it back. */
+  if (s->in_use == 0)
+    {
+      list_remove (&s->elem);
+      if (c->spare == NULL)
+        c->spare = s;
+      else
+        {
+          s->magic = 0;
+          c->slab_cnt--;
+          palloc_free_page (s);
+        }
+    }
+
+  c->free_cnt++;
+  c->in_use--;
+  adaptive_lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache that has been used. */
+void
+kmem_cache_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct kmem_cache *c = caches[i];
+      if (c->alloc_cnt > 0)
+        printf ("Cache %s: %zu-byte objects, %zu in use (peak %zu), "
+                "%zu slabs, %llu allocs, %llu frees\n",
+                c->name, c->obj_size, c->in_use, c->peak, c->slab_cnt,
+                c->alloc_cnt, c->free_cnt);
+    }
+}
+
+/* Frees the spare slab of each cache, until PAGE_CNT pages have
+   been freed, and returns the number freed.  Skips caches whose
+   lock is busy. */
+static size_t
+shrink_spares (size_t page_cnt)
+{
+  size_t freed = 0;
+  size_t i;
+
+  for (i = 0; i < cache_cnt && freed < page_cnt; i++)
+    {
+      struct kmem_cache *c = caches[i];
+      struct slab *s;
+
+      if (adaptive_lock_held_by_current_thread (&c->lock)
+          || !adaptive_lock_try_acquire (&c->lock))
+        continue;
+      s = c->spare;
+      if (s != NULL)
+        {
+          c->spare = NULL;
+          s->magic = 0;
+          c->slab_cnt--;
+        }
+      adaptive_lock_release (&c->lock);
+
+      if (s != NULL)
+        {
+          palloc_free_page (s);
+          freed++;
+        }
+    }
+  return freed;
+}
+
+/* Obtains a page from the page allocator and makes it into a
+   slab for cache C, with all its objects on its free list.
+   Returns the new slab, or a null pointer if memory is not
+   available.  C's lock must be held. */
+static struct slab *
+new_slab (struct kmem_cache *c)
+{
+  struct slab *s;
+  uint8_t *obj;
+  size_t i;
+
+  ASSERT (adaptive_lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free = NULL;
+  s->in_use = 0;
+
+  /* Link objects in address order, lowest first. */
+  obj = (uint8_t *) (s + 1) + c->objs_per_slab * c->stride;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      obj -= c->stride;
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *free_link (c, obj) = s->free;
+      s->free = obj;
+    }
+
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that OBJ, an object from cache C, is in. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT ((pg_ofs (obj) - sizeof *s) % c->stride == 0);
+
+  return s;
+}
+
+/* Returns the location of OBJ's free-list link. */
+static void **
+free_link (struct kmem_cache *c, void *obj)
+{
+  return (void **) ((uint8_t *) obj + c->link_ofs);
+}
@@ -29,6 +29,7 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
@@ -145,6 +146,10 @@ sema_try_down (struct semaphore *sema)
 	old_level = intr_disable ();
 	if (sema->value > 0) 
 	{
+		/* Record the holder, as sema_down() does, so that priority
+			 donation still finds it. */
+		if(sema->value == 1)
+			sema->threadelem = thread_current();
 		sema->value--;
 		success = true; 
 	}
@@ -214,6 +219,8 @@ sema_up (struct semaphore *sema)
 }
 
 static void sema_test_helper (void *sema_);
+static void acquire (struct lock *, const void *caller);
+static void note_contended (const struct lock *, const void *caller);
 
 /* Self-test for semaphores that makes control "ping-pong"
 	 between a pair of threads.  Insert calls to printf() to see
@@ -272,6 +279,8 @@ lock_init (struct lock *lock)
 
 	lock->holder = NULL;
 	sema_init (&lock->semaphore, 1);
+	lock->contend_cnt = 0;
+	lock->wait_cycles = 0;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -284,15 +293,115 @@ lock_init (struct lock *lock)
 	 we need to sleep. */
 	void
 lock_acquire (struct lock *lock)
+{
+	acquire (lock, __builtin_return_address (0));
+}
+
+/* Does the work of lock_acquire().  If LOCK is contended, charges
+	 the wait to LOCK and to the current thread and, unless CALLER
+	 is null, records LOCK as acquired by CALLER for
+	 lock_print_stats(). */
+	static void
+acquire (struct lock *lock, const void *caller)
 {
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	sema_down (&lock->semaphore);
+	if (lock->holder == NULL)
+		sema_down (&lock->semaphore);
+	else
+	{
+		/* Contended.  Once we hold LOCK, its counters are ours to
+			 update. */
+		uint64_t start = cpu_cycles ();
+		uint64_t wait;
+
+		sema_down (&lock->semaphore);
+		wait = cpu_cycles () - start;
+		thread_current ()->lock_wait_cycles += wait;
+		lock->contend_cnt++;
+		lock->wait_cycles += wait;
+		if (caller != NULL)
+			note_contended (lock, caller);
+	}
 	lock->holder = thread_current ();
 }
 
+/* Locks that have waited longest, for lock_print_stats().  Locks
+	 are known only by address, so a lock that is freed and another
+	 that later takes its place share an entry. */
+#define CONTENDED_MAX 16
+struct contended_lock
+{
+	const struct lock *lock;      /* The lock, or null if unused. */
+	const void *caller;           /* Where it was last acquired. */
+	unsigned long long contend_cnt; /* Copy of lock's counters. */
+	uint64_t wait_cycles;
+};
+static struct contended_lock contended[CONTENDED_MAX];
+
+/* Protects CONTENDED.  Zeroed, as spinlock_init() would leave it. */
+static struct spinlock contended_spinlock;
+
+/* Records the counters of LOCK, just acquired after waiting by
+	 CALLER, in CONTENDED, if it has waited at least as long as the
+	 locks already there. */
+	static void
+note_contended (const struct lock *lock, const void *caller)
+{
+	struct contended_lock *c, *min = NULL;
+
+	spinlock_acquire (&contended_spinlock);
+	for (c = contended; c < contended + CONTENDED_MAX; c++)
+	{
+		if (c->lock == lock)
+		{
+			min = c;
+			break;
+		}
+		if (min == NULL || c->wait_cycles < min->wait_cycles)
+			min = c;
+	}
+	if (min->lock == lock || min->lock == NULL
+			|| min->wait_cycles <= lock->wait_cycles)
+	{
+		min->lock = lock;
+		min->caller = caller;
+		min->contend_cnt = lock->contend_cnt;
+		min->wait_cycles = lock->wait_cycles;
+	}
+	spinlock_release (&contended_spinlock);
+}
+
+/* Prints the locks, other than adaptive locks, that have spent
+	 the most time contended, longest first, with the address of
+	 the code that last acquired each one after waiting. */
+	void
+lock_print_stats (void)
+{
+	bool printed[CONTENDED_MAX];
+	size_t i;
+
+	memset (printed, 0, sizeof printed);
+	for (;;)
+	{
+		struct contended_lock *max = NULL;
+
+		for (i = 0; i < CONTENDED_MAX; i++)
+			if (contended[i].lock != NULL && !printed[i]
+					&& (max == NULL || contended[i].wait_cycles > max->wait_cycles))
+				max = &contended[i];
+		if (max == NULL)
+			break;
+		printed[max - contended] = true;
+		printf ("Lock %p (acquired at %p): %llu contended, "
+				"%llu cycles waiting\n",
+				max->lock, max->caller, max->contend_cnt,
+				(unsigned long long) max->wait_cycles);
+	}
+}
+
 /* Tries to acquires LOCK and returns true if successful or false
 	 on failure.  The lock must not already be held by the current
 	 thread.
@@ -340,6 +449,123 @@ lock_held_by_current_thread (const struct lock *lock)
 	return lock->holder == thread_current ();
 }
 
+/* Number of spins an adaptive lock makes waiting for a running
+	 holder before it gives up and blocks. */
+#define ADAPTIVE_SPIN_LIMIT 1000
+
+/* Every adaptive lock, for adaptive_lock_print_stats(). */
+#define ADAPTIVE_LOCK_MAX 32
+static struct adaptive_lock *adaptive_locks[ADAPTIVE_LOCK_MAX];
+static size_t adaptive_lock_cnt;
+
+/* Initializes adaptive lock LOCK, naming it NAME for statistics. */
+	void
+adaptive_lock_init (struct adaptive_lock *lock, const char *name)
+{
+	ASSERT (lock != NULL);
+	ASSERT (name != NULL);
+
+	lock_init (&lock->lock);
+	lock->name = name;
+	lock->acquire_cnt = 0;
+	lock->contend_cnt = 0;
+	lock->spin_cnt = 0;
+	lock->wait_cycles = 0;
+	if (adaptive_lock_cnt < ADAPTIVE_LOCK_MAX)
+		adaptive_locks[adaptive_lock_cnt++] = lock;
+}
+
+/* Returns true if LOCK's holder is running right now, which can
+	 only be the case on another CPU. */
+static bool
+holder_running (const struct adaptive_lock *lock)
+{
+	struct thread *holder = lock->lock.holder;
+	return holder != NULL && holder->status == THREAD_RUNNING
+		&& holder != thread_current ();
+}
+
+/* Acquires LOCK.  If it is held by a thread that is running on
+	 another CPU, spins up to ADAPTIVE_SPIN_LIMIT times waiting for
+	 it to be released; otherwise, or if spinning fails, sleeps
+	 exactly like lock_acquire().  On a uniprocessor the holder is
+	 never running, so a contended acquisition always blocks right
+	 away. */
+	void
+adaptive_lock_acquire (struct adaptive_lock *lock)
+{
+	unsigned spins;
+	uint64_t start;
+
+	ASSERT (lock != NULL);
+	ASSERT (!intr_context ());
+
+	lock->acquire_cnt++;
+	if (lock_try_acquire (&lock->lock))
+		return;
+
+	lock->contend_cnt++;
+	start = cpu_cycles ();
+	for (spins = 0; spins < ADAPTIVE_SPIN_LIMIT && holder_running (lock); spins++)
+	{
+		barrier ();
+		if (lock_try_acquire (&lock->lock))
+		{
+			lock->spin_cnt++;
+			lock->wait_cycles += cpu_cycles () - start;
+			return;
+		}
+	}
+	acquire (&lock->lock, NULL);
+	lock->wait_cycles += cpu_cycles () - start;
+}
+
+/* Tries to acquire LOCK and returns true if successful or false
+	 on failure, without spinning or sleeping.  The lock must not
+	 already be held by the current thread. */
+	bool
+adaptive_lock_try_acquire (struct adaptive_lock *lock)
+{
+	ASSERT (lock != NULL);
+
+	if (!lock_try_acquire (&lock->lock))
+		return false;
+	lock->acquire_cnt++;
+	return true;
+}
+
+/* Releases LOCK, which must be owned by the current thread. */
+	void
+adaptive_lock_release (struct adaptive_lock *lock)
+{
+	lock_release (&lock->lock);
+}
+
+/* Returns true if the current thread holds LOCK. */
+	bool
+adaptive_lock_held_by_current_thread (const struct adaptive_lock *lock)
+{
+	return lock_held_by_current_thread (&lock->lock);
+}
+
+/* Prints contention statistics for every adaptive lock that has
+	 been acquired at least once. */
+	void
+adaptive_lock_print_stats (void)
+{
+	size_t i;
+
+	for (i = 0; i < adaptive_lock_cnt; i++)
+	{
+		struct adaptive_lock *lock = adaptive_locks[i];
+		if (lock->acquire_cnt > 0)
+			printf ("Lock %s: %llu acquires, %llu contended, %llu spun, "
+					"%llu cycles waiting\n",
+					lock->name, lock->acquire_cnt, lock->contend_cnt, lock->spin_cnt,
+					lock->wait_cycles);
+	}
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
 {
@@ -444,3 +670,167 @@ cond_broadcast (struct condition *cond, struct lock *lock)
 	while (!list_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
+
+/* Initializes RW.  A reader-writer lock may be held by any number
+	 of readers at once, or by a single writer.
+
+	 Writers are preferred: a writer holds RW's gate from the time
+	 it starts waiting until it releases RW, and every new reader
+	 must pass through the gate, so readers that arrive after a
+	 writer wait behind it.  Because the gate is an ordinary lock,
+	 threads waiting on it are woken in priority order and donate
+	 their priority to the writer holding it. */
+	void
+rwlock_init (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->gate);
+	lock_init (&rw->mutex);
+	cond_init (&rw->no_readers);
+	rw->readers = 0;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+	 is waiting for it. */
+	void
+rwlock_acquire_read (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->gate);
+	lock_acquire (&rw->mutex);
+	rw->readers++;
+	lock_release (&rw->mutex);
+	lock_release (&rw->gate);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+	void
+rwlock_release_read (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+
+	lock_acquire (&rw->mutex);
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_signal (&rw->no_readers, &rw->mutex);
+	lock_release (&rw->mutex);
+}
+
+/* Acquires RW for writing, sleeping until other writers and all
+	 active readers are done.  New readers are held off as soon as
+	 this function starts waiting. */
+	void
+rwlock_acquire_write (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->gate);
+	lock_acquire (&rw->mutex);
+	while (rw->readers > 0)
+		cond_wait (&rw->no_readers, &rw->mutex);
+	lock_release (&rw->mutex);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+	void
+rwlock_release_write (struct rwlock *rw)
+{
+	ASSERT (rw != NULL);
+	ASSERT (lock_held_by_current_thread (&rw->gate));
+
+	lock_release (&rw->gate);
+}
+
+/* Initializes spinlock LOCK, which is initially free. */
+	void
+spinlock_init (struct spinlock *lock)
+{
+	ASSERT (lock != NULL);
+
+	lock->locked = 0;
+	lock->holder = NULL;
+	lock->old_level = INTR_OFF;
+}
+
+/* Atomically sets *LOCKED to 1 and returns its old value. */
+static inline uint32_t
+test_and_set (volatile uint32_t *locked)
+{
+	uint32_t old = 1;
+	asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (*locked) : : "memory");
+	return old;
+}
+
+/* Acquires LOCK, spinning until it is free.  Turns interrupts
+	 off first, so that an interrupt handler on this CPU cannot
+	 spin forever on a lock its own CPU holds, and leaves them off
+	 until spinlock_release().
+
+	 This function may be called with interrupts off and from an
+	 interrupt handler. */
+	void
+spinlock_acquire (struct spinlock *lock)
+{
+	enum intr_level old_level;
+
+	ASSERT (lock != NULL);
+	ASSERT (!spinlock_held_by_current_cpu (lock));
+
+	old_level = intr_disable ();
+	while (test_and_set (&lock->locked))
+		while (lock->locked)
+			asm volatile ("pause");
+	lock->holder = cpu_current ();
+	lock->old_level = old_level;
+}
+
+/* Tries to acquire LOCK without spinning.  Returns true if
+	 successful, false otherwise. */
+	bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+	enum intr_level old_level;
+
+	ASSERT (lock != NULL);
+	ASSERT (!spinlock_held_by_current_cpu (lock));
+
+	old_level = intr_disable ();
+	if (test_and_set (&lock->locked))
+	{
+		intr_set_level (old_level);
+		return false;
+	}
+	lock->holder = cpu_current ();
+	lock->old_level = old_level;
+	return true;
+}
+
+/* Releases LOCK, which must be held by the current CPU, and
+	 restores the interrupt level from before it was acquired. */
+	void
+spinlock_release (struct spinlock *lock)
+{
+	enum intr_level old_level;
+
+	ASSERT (lock != NULL);
+	ASSERT (spinlock_held_by_current_cpu (lock));
+
+	old_level = lock->old_level;
+	lock->holder = NULL;
+	barrier ();
+	lock->locked = 0;
+	intr_set_level (old_level);
+}
+
+/* Returns true if the current CPU holds LOCK, false otherwise. */
+	bool
+spinlock_held_by_current_cpu (const struct spinlock *lock)
+{
+	ASSERT (lock != NULL);
+
+	return lock->locked && lock->holder == cpu_current ();
+}
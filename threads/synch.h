@@ -3,6 +3,8 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
 
 
 /* A counting semaphore. */
@@ -25,6 +27,8 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    unsigned long long contend_cnt;     /* # of acquires that found it held. */
+    uint64_t wait_cycles;       /* Cycles spent waiting in those. */
   };
 
 void lock_init (struct lock *);
@@ -32,6 +36,28 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
+
+/* Adaptive lock.  A lock that spins for a short while if its
+   holder is running on another CPU and otherwise blocks, for
+   short critical sections where two context switches cost more
+   than the critical section itself. */
+struct adaptive_lock 
+  {
+    struct lock lock;           /* Underlying blocking lock. */
+    const char *name;           /* Name (for statistics). */
+    unsigned long long acquire_cnt;     /* # of acquisitions. */
+    unsigned long long contend_cnt;     /* # that found the lock held. */
+    unsigned long long spin_cnt;        /* # of contended ones won by spinning. */
+    unsigned long long wait_cycles;     /* Cycles spent waiting when contended. */
+  };
+
+void adaptive_lock_init (struct adaptive_lock *, const char *name);
+void adaptive_lock_acquire (struct adaptive_lock *);
+bool adaptive_lock_try_acquire (struct adaptive_lock *);
+void adaptive_lock_release (struct adaptive_lock *);
+bool adaptive_lock_held_by_current_thread (const struct adaptive_lock *);
+void adaptive_lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -44,6 +70,38 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock 
+  {
+    struct lock gate;           /* Held by the active or next writer. */
+    struct lock mutex;          /* Protects READERS. */
+    struct condition no_readers;        /* Signaled when READERS hits 0. */
+    int readers;                /* Number of active readers. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
+/* Spinlock.  Busy-waits instead of sleeping, so it can be taken
+   with interrupts off, e.g. inside the scheduler, and protects
+   data shared between CPUs.  Interrupts stay off on the holding
+   CPU until it is released.  Never sleep while holding one. */
+struct spinlock 
+  {
+    volatile uint32_t locked;   /* Nonzero while held. */
+    struct cpu *holder;         /* CPU holding lock (for debugging). */
+    enum intr_level old_level;  /* Holder's interrupt level before. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
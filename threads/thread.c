@@ -4,13 +4,22 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/arena.h"
+#include "threads/cpu.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/kstack.h"
+#include "threads/lapic.h"
 #include "threads/palloc.h"
+#include "threads/shrinker.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,16 +33,32 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* List of all threads.  Threads are added to this list when
+   they are created and removed when they exit. */
+static struct list all_list;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Kernel stack slots of exited threads, kept for reuse by
+   thread_create() along with their emptied page tables.
+   schedule_tail() cannot free a slot, because it runs with
+   interrupts off and freeing a page table may block, so it adds
+   the slot to the cache, or to thread_doomed once the cache holds
+   THREAD_CACHE_MAX slots.  Doomed slots are freed by doom_work,
+   which thread_exit() queues when the cache is full, or by the
+   next thread_create(), whichever comes first.  Under memory
+   pressure, thread_cache_shrinker frees the stacks of cached
+   slots, which thread_create() backs again on reuse. */
+#define THREAD_CACHE_MAX 8
+static struct list thread_cache;
+static size_t thread_cache_cnt;
+static struct list thread_doomed;
+static struct work doom_work;
+static struct shrinker thread_cache_shrinker;
+static long long thread_cache_hits;     /* # of slots reused. */
+static long long thread_cache_misses;   /* # of slots allocated. */
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -45,25 +70,75 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
-/* Scheduling. */
+/* Scheduling.  The run queues, idle threads and statistics are
+   per-CPU: see struct cpu. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Stride scheduling.  A thread holding tickets is in the stride
+   class.  Among ready threads of equal priority, the stride
+   thread with the smallest pass runs first, and each tick it
+   runs advances its pass by its stride, which is inversely
+   proportional to its tickets.  Over time each stride thread
+   thus gets a share of the CPU proportional to its tickets,
+   relative to the others at its priority.  Threads without
+   tickets are scheduled round-robin as before. */
+#define STRIDE1 (1 << 20)       /* Stride of a thread with 1 ticket. */
+int thread_stride_tickets;      /* Default tickets, 0 for none. */
+static int64_t stride_pass;     /* Pass of last stride thread to run. */
+
+/* Ticks run by stride threads, by ticket count, for
+   thread_print_stats(). */
+#define STRIDE_STATS_CNT 8
+struct stride_stat
+  {
+    int tickets;                /* Ticket count, 0 if unused. */
+    long long ticks;            /* Ticks run with that many tickets. */
+  };
+static struct stride_stat stride_stats[STRIDE_STATS_CNT];
+
+/* Run-queue latency histogram.  Bucket I counts the times a
+   thread waited from 2**I up to 2**(I+1) cycles (bucket 0 also
+   counts waits of 0 cycles) between being made ready and running. */
+#define LATENCY_BUCKETS 40
+static unsigned long long latency_hist[LATENCY_BUCKETS];
+
+/* Accounting for the most recently exited threads, so that
+   short-lived threads still show up in thread_print_stats(). */
+#define EXITED_CNT 16
+struct exited_thread
+  {
+    tid_t tid;                  /* Thread identifier, 0 if unused. */
+    char name[16];              /* Name. */
+    struct thread_stats stats;  /* Final statistics. */
+  };
+static struct exited_thread exited[EXITED_CNT];
+static int exited_next;         /* Next slot in exited[] to reuse. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static struct thread *steal_thread (struct cpu *);
+static struct thread *pop_ready (struct list *);
+static void kick_cpu (struct cpu *);
+static void stride_account (int tickets);
+static void stride_print_stats (void);
+static void thread_print_accounting (void);
+static int latency_bucket (uint64_t cycles);
+static void record_exit (struct thread *);
+static struct thread *thread_cache_get (void);
+static void free_doomed (void *aux);
+static shrink_func shrink_thread_cache;
+static void get_stats (struct thread *, struct thread_stats *);
+static void print_thread_stats (tid_t, const char *,
+                                const struct thread_stats *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -76,7 +151,8 @@ static tid_t allocate_tid (void);
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the bootstrap processor's run queue and the
+   tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -90,11 +166,17 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
-	list_init (&execute_list);
+  cpu_init ();
+  list_init (&all_list);
+  list_init (&thread_cache);
+  list_init (&thread_doomed);
+  work_init (&doom_work, free_doomed, NULL);
+  shrinker_register (&thread_cache_shrinker, "thread cache", SHRINK_CACHE,
+                     shrink_thread_cache);
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  initial_thread->cpu = &cpus[0];
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
 }
@@ -108,11 +190,12 @@ thread_start (void)
   struct semaphore idle_started;
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
+  cpu_current ()->online = true;
 
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize its CPU's idle_thread. */
   sema_down (&idle_started);
 }
 
@@ -122,28 +205,155 @@ void
 thread_tick (void) 
 {
   struct thread *t = thread_current ();
+  struct cpu *c = t->cpu;
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == c->idle_thread)
+    c->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    c->user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    c->kernel_ticks++;
+  t->run_ticks++;
+  if (t->tickets > 0)
+    {
+      t->pass += t->stride;
+      stride_account (t->tickets);
+    }
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++c->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, totaled over all CPUs and then, if
+   there is more than one, for each CPU. */
 void
 thread_print_stats (void) 
 {
+  long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      idle_ticks += cpus[i].idle_ticks;
+      kernel_ticks += cpus[i].kernel_ticks;
+      user_ticks += cpus[i].user_ticks;
+    }
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread cache: %lld hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
+  if (cpu_cnt > 1)
+    for (i = 0; i < cpu_cnt; i++)
+      if (cpus[i].online)
+        printf ("CPU %d: %lld idle ticks, %lld kernel ticks, "
+                "%lld user ticks, %lld steals\n",
+                i, cpus[i].idle_ticks, cpus[i].kernel_ticks,
+                cpus[i].user_ticks, cpus[i].steal_cnt);
+  stride_print_stats ();
+  thread_print_accounting ();
+  lock_print_stats ();
+}
+
+/* Prints per-thread accounting for every live thread and the
+   most recently exited ones, then the run-queue latency
+   histogram. */
+static void
+thread_print_accounting (void) 
+{
+  struct list_elem *e;
+  int i, last;
+
+  printf ("Thread accounting (tid, name, run ticks, ready cycles, "
+          "lock wait cycles, voluntary/involuntary switches):\n");
+  for (i = 0; i < EXITED_CNT; i++)
+    {
+      struct exited_thread *x = &exited[(exited_next + i) % EXITED_CNT];
+      if (x->tid != 0)
+        print_thread_stats (x->tid, x->name, &x->stats);
+    }
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      struct thread_stats stats;
+
+      get_stats (t, &stats);
+      print_thread_stats (t->tid, t->name, &stats);
+    }
+
+  for (last = LATENCY_BUCKETS - 1; last > 0; last--)
+    if (latency_hist[last] != 0)
+      break;
+  printf ("Run-queue latency (cycles):\n");
+  for (i = 0; i <= last; i++)
+    printf ("  %12llu+: %llu\n", i > 0 ? 1ULL << i : 0ULL, latency_hist[i]);
+}
+
+/* Prints one row of thread_print_accounting(). */
+static void
+print_thread_stats (tid_t tid, const char *name,
+                    const struct thread_stats *stats) 
+{
+  printf ("  %4d %-16s %8lld %14llu %14llu %6u/%u\n",
+          tid, name, stats->run_ticks, stats->ready_cycles,
+          stats->lock_wait_cycles, stats->voluntary_switches,
+          stats->involuntary_switches);
+}
+
+/* Stores T's accounting into STATS. */
+static void
+get_stats (struct thread *t, struct thread_stats *stats) 
+{
+  stats->now = timer_ticks ();
+  stats->run_ticks = t->run_ticks;
+  stats->ready_cycles = t->ready_cycles;
+  stats->lock_wait_cycles = t->lock_wait_cycles;
+  stats->voluntary_switches = t->voluntary_switches;
+  stats->involuntary_switches = t->involuntary_switches;
+}
+
+/* Stores the running thread's accounting into STATS. */
+void
+thread_get_stats (struct thread_stats *stats) 
+{
+  get_stats (thread_current (), stats);
+}
+
+/* Adds a tick to the statistics for threads with TICKETS
+   tickets.  Ticket counts beyond the first STRIDE_STATS_CNT seen
+   are not tracked. */
+static void
+stride_account (int tickets) 
+{
+  int i;
+
+  for (i = 0; i < STRIDE_STATS_CNT; i++)
+    if (stride_stats[i].tickets == tickets || stride_stats[i].tickets == 0)
+      {
+        stride_stats[i].tickets = tickets;
+        stride_stats[i].ticks++;
+        return;
+      }
+}
+
+/* Prints the ticks run by stride threads for each ticket count,
+   as a share of all ticks run by stride threads. */
+static void
+stride_print_stats (void) 
+{
+  long long total = 0;
+  int i;
+
+  for (i = 0; i < STRIDE_STATS_CNT && stride_stats[i].tickets != 0; i++)
+    total += stride_stats[i].ticks;
+  for (i = 0; i < STRIDE_STATS_CNT && stride_stats[i].tickets != 0; i++)
+    printf ("Stride: %d tickets: %lld ticks (%lld%%)\n",
+            stride_stats[i].tickets, stride_stats[i].ticks,
+            stride_stats[i].ticks * 100 / total);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -169,22 +379,33 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  struct pt *page_table;
   tid_t tid;
 
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_cache_get ();
   if (t == NULL)
     return TID_ERROR;
 
-  /* Initialize thread. */
+  /* Initialize thread, keeping any page table it came with. */
+  page_table = t->page_table;
   init_thread (t, name, priority);
+  t->page_table = page_table;
   tid = t->tid = allocate_tid ();
+  t->cpu = cpu_current ();
+  if (thread_stride_tickets > 0 && function != idle)
+    {
+      t->tickets = thread_stride_tickets;
+      t->stride = STRIDE1 / t->tickets;
+      t->pass = stride_pass;
+    }
 
 #ifdef VM
 	/*this part for initialize of page_table variable */
-	t->page_table = init_page_table();
+	if (t->page_table == NULL)
+		t->page_table = init_page_table();
 #endif
 
   /* Stack frame for kernel_thread(). */
@@ -250,12 +471,27 @@ thread_unblock (struct thread *t)
   ASSERT (is_thread (t));
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_insert_ordered(&ready_list, &t->elem, orderprio, NULL);
+
+  /* Don't let a stride thread bank credit while blocked. */
+  if (t->tickets > 0 && t->pass < stride_pass)
+    t->pass = stride_pass;
+
+  spinlock_acquire (&t->cpu->ready_lock);
+  list_insert_ordered(&t->cpu->ready_list, &t->elem, orderprio, NULL);
   t->status = THREAD_READY;
+  t->ready_since = cpu_cycles ();
+  spinlock_release (&t->cpu->ready_lock);
  //list_push_back (&ready_list, &t->elem);
-
-  if(thread_current() != idle_thread && t->priority > thread_current()->priority){
-    thread_yield();
+  kick_cpu (t->cpu);
+
+  /* Only T's own CPU runs it, or steals it when idle, so only
+     that CPU's running thread can be preempted for it. */
+  if(t->cpu == cpu_current () && thread_current() != cpu_current ()->idle_thread && t->priority > thread_current()->priority){
+    /* An interrupt handler can't yield until it returns. */
+    if (intr_context ())
+      intr_yield_on_return ();
+    else
+      thread_yield();
   }
   intr_set_level (old_level);
 }
@@ -303,6 +539,15 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_thread_exit (thread_current ());
+  arena_thread_exit (thread_current ());
+
+  /* If the cache is full, our slot will be doomed, so have it
+     freed.  The low-priority worker normally runs only after we
+     are gone; a slot it misses is freed by the next
+     thread_create(). */
+  if (thread_cache_cnt >= THREAD_CACHE_MAX)
+    work_queue (&doom_work, WORK_LOW);
 
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
@@ -321,9 +566,14 @@ thread_yield (void)
   enum intr_level old_level;
   ASSERT (!intr_context ());
   old_level = intr_disable ();
-  if (curr != idle_thread) 
-    list_insert_ordered(&ready_list, &curr->elem, orderprio, NULL);
+  if (curr != curr->cpu->idle_thread) 
+    {
+      spinlock_acquire (&curr->cpu->ready_lock);
+      list_insert_ordered(&curr->cpu->ready_list, &curr->elem, orderprio, NULL);
+      spinlock_release (&curr->cpu->ready_lock);
+    }
   curr->status = THREAD_READY;
+  curr->ready_since = cpu_cycles ();
   schedule ();
   intr_set_level (old_level);
 }
@@ -364,6 +614,32 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
+/* Returns the current thread's stride tickets, or 0 if it is not
+   in the stride class. */
+int
+thread_get_tickets (void) 
+{
+  return thread_current ()->tickets;
+}
+
+/* Gives the current thread TICKETS stride tickets, moving it into
+   the stride class, or out of it if TICKETS is 0. */
+void
+thread_set_tickets (int tickets) 
+{
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (tickets >= 0 && tickets <= TICKETS_MAX);
+
+  old_level = intr_disable ();
+  if (curr->tickets == 0)
+    curr->pass = stride_pass;
+  curr->tickets = tickets;
+  curr->stride = tickets > 0 ? STRIDE1 / tickets : 0;
+  intr_set_level (old_level);
+}
+
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int nice UNUSED) 
@@ -397,27 +673,82 @@ thread_get_recent_cpu (void)
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
-   thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   The bootstrap processor's idle thread is initially put on the
+   ready list by thread_start().  It will be scheduled once
+   initially, at which point it initializes idle_thread, "up"s
+   the semaphore passed to it to enable thread_start() to
+   continue, and immediately blocks.  After that, the idle thread
+   never appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when its CPU has
+   nothing else to run.  Application processors' idle threads
+   are made by thread_create_idle() instead. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  cpu_current ()->idle_thread = thread_current ();
+  intr_set_level (old_level);
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* Creates the idle thread of application processor C, which is
+   not running yet, and returns it, or a null pointer if memory
+   is short.  C starts out running it, in cpu_ap_main(), and
+   never runs it anywhere but thread_start_ap(). */
+struct thread *
+thread_create_idle (struct cpu *c) 
+{
+  struct thread *t;
+  char name[16];
+
+  t = kstack_alloc ();
+  if (t == NULL)
+    return NULL;
+  snprintf (name, sizeof name, "idle%d", c->id);
+  init_thread (t, name, PRI_MIN);
+  t->tid = allocate_tid ();
+  t->cpu = c;
+  t->status = THREAD_RUNNING;
+  c->idle_thread = t;
+  return t;
+}
+
+/* Called by cpu_ap_main() once the running application
+   processor can schedule threads, with interrupts off and the
+   big kernel lock held.  Becomes the processor's idle thread. */
+void
+thread_start_ap (void) 
+{
+  struct thread *t = running_thread ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t == t->cpu->idle_thread);
+
+  t->cpu->idle = true;
+  fpu_switch (t);
+  idle_loop ();
+}
+
+/* Main loop of every CPU's idle thread. */
+static void
+idle_loop (void) 
+{
   for (;;) 
     {
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
-      /* Re-enable interrupts and wait for the next one.
+      /* Nothing else wants to run, so zero a free page for later
+         PAL_ZERO requests, if there is one to zero. */
+      if (palloc_zero_idle ())
+        continue;
+
+      /* Release the big kernel lock, re-enable interrupts and
+         wait for the next one.
 
          The `sti' instruction disables interrupts until the
          completion of the next instruction, so these two
@@ -427,9 +758,16 @@ idle (void *idle_started_ UNUSED)
          one to occur, wasting as much as one clock tick worth of
          time.
 
+         intr_handler() takes the big kernel lock back, except
+         for a TLB shootdown, which it handles without the lock:
+         after one of those there is still nothing to do.
+
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      big_lock_release ();
+      do
+        asm volatile ("sti; hlt; cli" : : : "memory");
+      while (!big_lock_held ());
     }
 }
 
@@ -451,11 +789,12 @@ running_thread (void)
   uint32_t *esp;
 
   /* Copy the CPU's stack pointer into `esp', and then round that
-     down to the start of a page.  Since `struct thread' is
-     always at the beginning of a page and the stack pointer is
-     somewhere in the middle, this locates the curent thread. */
+     down to the start of its kernel stack slot.  Since `struct
+     thread' is always at the beginning of the slot and the stack
+     pointer is somewhere in the middle, this locates the curent
+     thread. */
   asm ("mov %%esp, %0" : "=g" (esp));
-  return pg_round_down (esp);
+  return kstack_owner (esp);
 }
 
 /* Returns true if T appears to point to a valid thread. */
@@ -470,6 +809,8 @@ is_thread (struct thread *t)
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -477,7 +818,7 @@ init_thread (struct thread *t, const char *name, int priority)
   memset (t, 0, sizeof *t);
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
+  t->stack = kstack_top (t);
   t->priority = priority;
   t->magic = THREAD_MAGIC;
   list_init(&t->locking);
@@ -489,12 +830,15 @@ init_thread (struct thread *t, const char *name, int priority)
   //reverse for fd_set[0] and fd_set[1]
   t->fd_set[0] = (void *)1;
   t->fd_set[1] = (void *)1;
-	sema_init(&t->wait, 0);
-	t->waitfor = -1;
-	t->parent_id = NULL;
+	list_init(&t->children);
 	t->selffile = NULL;
+	t->process = t;
 
 	list_init(&t->mmap_table);
+
+  old_level = intr_disable ();
+  list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -510,18 +854,120 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Chooses and returns the next thread to be scheduled on the
+   current CPU.  Should return a thread from this CPU's run queue,
+   unless the run queue is empty.  (If the running thread can
+   continue running, then it will be in the run queue.)  If the
+   run queue is empty, tries to steal a thread from another CPU,
+   and failing that returns this CPU's idle thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  struct cpu *c = cpu_current ();
+  struct thread *next = NULL;
+
+  spinlock_acquire (&c->ready_lock);
+  if (!list_empty (&c->ready_list))
+    next = pop_ready (&c->ready_list);
+  spinlock_release (&c->ready_lock);
+
+  if (next == NULL)
+    next = steal_thread (c);
+  return next != NULL ? next : c->idle_thread;
+}
+
+/* Removes and returns the thread to run next from READY, which
+   must not be empty.  That is the front, highest-priority
+   thread, unless it is in the stride class: then it is the
+   stride thread with the smallest pass among those of the same
+   priority. */
+static struct thread *
+pop_ready (struct list *ready) 
+{
+  struct thread *front = list_entry (list_front (ready), struct thread, elem);
+  struct thread *next = front;
+  struct list_elem *e;
+
+  if (front->tickets > 0)
+    for (e = list_next (&front->elem); e != list_end (ready);
+         e = list_next (e))
+      {
+        struct thread *t = list_entry (e, struct thread, elem);
+        if (t->priority != front->priority)
+          break;
+        if (t->tickets > 0 && t->pass < next->pass)
+          next = t;
+      }
+  list_remove (&next->elem);
+  if (next->tickets > 0)
+    stride_pass = next->pass;
+  return next;
+}
+
+/* Takes the highest-priority ready thread from the busiest other
+   online CPU and moves it to C.  Returns the thread, or a null
+   pointer if no other CPU has a ready thread to spare. */
+static struct thread *
+steal_thread (struct cpu *c) 
+{
+  struct cpu *victim = NULL;
+  size_t victim_cnt = 0;
+  struct thread *t = NULL;
+  int i;
+
+  /* Pick a victim without locking: the lengths are only hints. */
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != c && cpus[i].online)
+      {
+        size_t cnt = list_size (&cpus[i].ready_list);
+        if (cnt > victim_cnt)
+          {
+            victim = &cpus[i];
+            victim_cnt = cnt;
+          }
+      }
+  if (victim == NULL)
+    return NULL;
+
+  spinlock_acquire (&victim->ready_lock);
+  if (!list_empty (&victim->ready_list))
+    {
+      t = pop_ready (&victim->ready_list);
+      if (victim->fpu_owner == t)
+        {
+          /* Its FPU state is still in the victim's FPU. */
+          list_push_front (&victim->ready_list, &t->elem);
+          t = NULL;
+        }
+      else
+        {
+          t->cpu = c;
+          c->steal_cnt++;
+        }
+    }
+  spinlock_release (&victim->ready_lock);
+  return t;
+}
+
+/* Wakes up an idle CPU to run a thread just added to C's run
+   queue: C itself, if it is idle, or else another idle CPU, which
+   will steal the thread.  If C is the running CPU and is idle,
+   it is about to run the thread anyway. */
+static void
+kick_cpu (struct cpu *c) 
+{
+  struct cpu *self = cpu_current ();
+  int i;
+
+  if (c != self && c->idle)
+    lapic_send_ipi (c->apic_id, LAPIC_VEC_KICK);
+  else if (!self->idle)
+    for (i = 0; i < cpu_cnt; i++)
+      if (cpus[i].online && cpus[i].idle && &cpus[i] != c)
+        {
+          lapic_send_ipi (cpus[i].apic_id, LAPIC_VEC_KICK);
+          break;
+        }
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -551,25 +997,201 @@ schedule_tail (struct thread *prev)
   curr->status = THREAD_RUNNING;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  curr->cpu->thread_ticks = 0;
+  curr->cpu->idle = curr == curr->cpu->idle_thread;
+
+  /* Account for the time we spent waiting to run. */
+  if (curr->ready_since != 0)
+    {
+      uint64_t wait = cpu_cycles () - curr->ready_since;
+      curr->ready_cycles += wait;
+      latency_hist[latency_bucket (wait)]++;
+      curr->ready_since = 0;
+    }
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
 
+  /* Make the FPU trap unless it holds our state. */
+  fpu_switch (curr);
+
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
-     palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
+     kstack_alloc().) */
+  if (prev != NULL && prev->status == THREAD_DYING) 
     {
       ASSERT (prev != curr);
-      palloc_free_page (prev);
+      record_exit (prev);
+      if (prev != initial_thread && thread_cache_cnt < THREAD_CACHE_MAX)
+        {
+          list_push_front (&thread_cache, &prev->elem);
+          thread_cache_cnt++;
+        }
+      else if (prev != initial_thread)
+        list_push_back (&thread_doomed, &prev->elem);
+    }
+}
+
+/* Returns a kernel stack slot for a new thread, preferably one
+   from the thread cache, or a null pointer if none is available.
+   The slot is not zeroed; its page_table member is either an
+   empty page table to reuse or a null pointer.  Also frees
+   doomed slots. */
+static struct thread *
+thread_cache_get (void) 
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  free_doomed (NULL);
+
+  old_level = intr_disable ();
+  if (!list_empty (&thread_cache))
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+    }
+  intr_set_level (old_level);
+
+  /* The shrinker may have taken the slot's stack. */
+  if (t != NULL)
+    {
+      if (kstack_refill (t))
+        thread_cache_hits++;
+      else
+        {
+#ifdef VM
+          destroy_page_table (t->page_table);
+#endif
+          kstack_free (t);
+          return NULL;
+        }
+    }
+
+  if (t == NULL)
+    {
+      /* The slot's memory is not cleared, and need not be:
+         init_thread() clears the struct thread, and the stack
+         needs no clearing. */
+      t = kstack_alloc ();
+      if (t == NULL)
+        return NULL;
+      t->page_table = NULL;
+      thread_cache_misses++;
+    }
+  return t;
+}
+
+/* Frees the slots that schedule_tail() doomed, with their page
+   tables.  Runs as doom_work, or directly from a thread that may
+   block. */
+static void
+free_doomed (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      struct thread *t;
+      enum intr_level old_level;
+
+      old_level = intr_disable ();
+      if (list_empty (&thread_doomed))
+        {
+          intr_set_level (old_level);
+          break;
+        }
+      t = list_entry (list_pop_front (&thread_doomed), struct thread, elem);
+      intr_set_level (old_level);
+
+#ifdef VM
+      destroy_page_table (t->page_table);
+#endif
+      kstack_free (t);
     }
 }
 
+/* Shrinker for the thread cache.  Frees the stacks of cached
+   slots, coldest first, until PAGE_CNT pages are freed, and
+   returns the number freed.  The slots themselves, with their
+   thread pages and page tables, stay cached: freeing a page table
+   may block, which a shrinker must not do. */
+static size_t
+shrink_thread_cache (size_t page_cnt) 
+{
+  struct list trimmed;
+  size_t freed = 0;
+  size_t cnt;
+
+  list_init (&trimmed);
+  for (cnt = thread_cache_cnt; cnt > 0 && freed < page_cnt; cnt--)
+    {
+      struct thread *t;
+      enum intr_level old_level;
+
+      old_level = intr_disable ();
+      if (list_empty (&thread_cache))
+        {
+          intr_set_level (old_level);
+          break;
+        }
+      t = list_entry (list_pop_back (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+      intr_set_level (old_level);
+
+      freed += kstack_trim (t);
+      list_push_front (&trimmed, &t->elem);
+    }
+
+  /* Put the slots back where they were, unless the cache filled
+     up in the meantime. */
+  while (!list_empty (&trimmed))
+    {
+      struct thread *t = list_entry (list_pop_front (&trimmed),
+                                     struct thread, elem);
+      enum intr_level old_level = intr_disable ();
+      if (thread_cache_cnt < THREAD_CACHE_MAX)
+        {
+          list_push_back (&thread_cache, &t->elem);
+          thread_cache_cnt++;
+        }
+      else
+        list_push_back (&thread_doomed, &t->elem);
+      intr_set_level (old_level);
+    }
+  return freed;
+}
+
+/* Returns the latency_hist[] bucket for a wait of CYCLES. */
+static int
+latency_bucket (uint64_t cycles) 
+{
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < LATENCY_BUCKETS - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Removes dying thread T from the list of all threads, saving its
+   accounting in exited[]. */
+static void
+record_exit (struct thread *t) 
+{
+  struct exited_thread *x = &exited[exited_next];
+
+  list_remove (&t->allelem);
+  x->tid = t->tid;
+  strlcpy (x->name, t->name, sizeof x->name);
+  get_stats (t, &x->stats);
+  exited_next = (exited_next + 1) % EXITED_CNT;
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -587,14 +1209,24 @@ schedule (void)
 
 
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (big_lock_held ());
   ASSERT (curr->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
   old_level = intr_disable ();
 
+  /* Only a yield forced by intr_handler() is involuntary; a
+     thread that yields, blocks or exits on its own gives up the
+     CPU by choice. */
   if (curr != next){
+	if (curr->preempted)
+	  curr->involuntary_switches++;
+	else
+	  curr->voluntary_switches++;
+	TRACE (TRACE_SWITCH, curr->tid, next->tid);
 	prev = switch_threads (curr, next);
   }
+  curr->preempted = false;
   intr_set_level(old_level);
   schedule_tail (prev); 
 }
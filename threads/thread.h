@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include <thread-stats.h>
 
 #include "threads/synch.h"
 
@@ -30,58 +32,60 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Stride scheduling tickets. */
+#define TICKETS_MAX 10000               /* Most tickets a thread may hold. */
+
 #define MAXFD 512
 
 /* A kernel thread or user process.
 
-Each thread structure is stored in its own 4 kB page.  The
-thread structure itself sits at the very bottom of the page
-(at offset 0).  The rest of the page is reserved for the
-thread's kernel stack, which grows downward from the top of
-the page (at offset 4 kB).  Here's an illustration:
+Each thread structure is stored in its own kernel stack slot
+(see kstack.c).  The thread structure itself sits at the very
+bottom of the slot (at offset 0), alone in the slot's first
+page.  The thread's kernel stack, of kstack_pages pages, grows
+downward from the top of the slot, and between the two lies a
+guard that is never mapped.  Here's an illustration:
 
-4 kB +---------------------------------+
+top  +---------------------------------+
 |          kernel stack           |
 |                |                |
 |                |                |
 |                V                |
 |         grows downward          |
 |                                 |
++---------------------------------+
+|              guard              |
 |                                 |
++---------------------------------+
 |                                 |
 |                                 |
-|                                 |
-|                                 |
-|                                 |
-|                                 |
-+---------------------------------+
 |              magic              |
 |                :                |
 |                :                |
 |               name              |
 |              status             |
-0 kB +---------------------------------+
+0    +---------------------------------+
 
 The upshot of this is twofold:
 
-1. First, `struct thread' must not be allowed to grow too
-big.  If it does, then there will not be enough room for
-the kernel stack.  Our base `struct thread' is only a
-few bytes in size.  It probably should stay well under 1
-kB.
+1. First, `struct thread' must not be allowed to grow
+bigger than a page.
 
 2. Second, kernel stacks must not be allowed to grow too
-large.  If a stack overflows, it will corrupt the thread
-state.  Thus, kernel functions should not allocate large
-structures or arrays as non-static local variables.  Use
-dynamic allocation with malloc() or palloc_get_page()
-instead.
-
-The first symptom of either of these problems will probably be
-an assertion failure in thread_current(), which checks that
-the `magic' member of the running thread's `struct thread' is
-set to THREAD_MAGIC.  Stack overflow will normally change this
-value, triggering the assertion. */
+large.  A stack that overflows runs into the guard, and
+the resulting double fault panics the kernel.  Local
+buffers of a few hundred bytes are fine, but larger
+structures should still be allocated with malloc() or
+palloc_get_page(), or the stack made bigger with the
+"-ks" option.
+
+The initial thread is the exception: it runs on the page
+set up by the loader, with its stack above `struct thread'
+in the same page and no guard.  If its stack overflows, the
+first symptom will probably be an assertion failure in
+thread_current(), which checks that the `magic' member of
+the running thread's `struct thread' is set to
+THREAD_MAGIC. */
 /* The `elem' member has a dual purpose.  It can be an element in
 the run queue (thread.c), or it can be an element in a
 semaphore wait list (synch.c).  It can be used these two ways
@@ -89,8 +93,6 @@ only because they are mutually exclusive: only a thread in the
 ready state is on the run queue, whereas only a thread in the
 blocked state is on a semaphore wait list. */
 
-
-struct list execute_list; /* for saving all excuting process */
 struct thread
 {
 	/* Owned by thread.c. */
@@ -99,10 +101,28 @@ struct thread
 	char name[16];                      /* Name (for debugging purposes). */
 	uint8_t *stack;                     /* Saved stack pointer. */
 	int priority;                       /* Priority. */
+	struct cpu *cpu;                    /* CPU it runs or is queued on. */
+	int tickets;                        /* Stride tickets, 0 if not stride. */
+	int stride;                         /* STRIDE1 / tickets. */
+	int64_t pass;                       /* Stride virtual time. */
+	void *fpu_state;                    /* Saved FPU state, owned by fpu.c. */
+	uint8_t *arena;                     /* Scratch page, owned by arena.c. */
+	size_t arena_used;                  /* Bytes of it in use, ditto. */
+
+	struct list_elem allelem;           /* List element for all threads list. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 
+	/* Accounting, owned by thread.c except lock_wait_cycles. */
+	int64_t run_ticks;                  /* Ticks spent running. */
+	uint64_t ready_since;               /* Cycle count when made ready. */
+	uint64_t ready_cycles;              /* Cycles spent ready. */
+	uint64_t lock_wait_cycles;          /* Cycles blocked in lock_acquire(). */
+	unsigned voluntary_switches;        /* Switches away by choice. */
+	unsigned involuntary_switches;      /* Switches away on preemption. */
+	bool preempted;                     /* Yielding on interrupt return? */
+
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint32_t *pagedir;                  /* Page directory. */
@@ -118,13 +138,19 @@ struct thread
 
 	/* below variable for PJ2 */
 	void * fd_set[MAXFD];	/* for saving fd which this thread use */
-	struct semaphore wait; /* for do exec and wait */
-	struct list_elem e_elem; /* for saving executing process */
-	tid_t waitfor; /* for wait function */
-	int child_exit_status; /* for saving child exit status and my exit status */
-	struct thread* parent_id; /* for saving my parent */
+	int child_exit_status; /* my exit status, reported to my parent */
+	struct child_status *exit_record; /* my record in my parent's children */
+	struct list children; /* records of children not yet waited for */
+	struct hash children_by_tid; /* the same records, keyed by tid */
+	bool children_hashed; /* children_by_tid initialized? */
 	struct file* selffile; /* what excutable file make this thread */
 
+	/* user threads, owned by userprog/process.c */
+	struct thread *process; /* thread whose address space and files I use */
+	struct thread_group *group; /* threads of my process, NULL if just me */
+	void *ustack; /* bottom of my user stack, if I am a user thread */
+	bool thread_exited; /* did I end through the thread_exit syscall? */
+
 	/* below varibable for PJ3 */
 	struct pt *page_table;
 	void *esp;
@@ -136,11 +162,18 @@ If true, use multi-level feedback queue scheduler.
 Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If nonzero, the number of stride tickets given to each new
+   thread.  Controlled by kernel command-line option "-stride". */
+extern int thread_stride_tickets;
+
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_get_stats (struct thread_stats *);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -158,6 +191,9 @@ void thread_yield (void);
 int thread_get_priority (void);
 void thread_set_priority (int);
 
+int thread_get_tickets (void);
+void thread_set_tickets (int);
+
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
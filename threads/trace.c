@@ -0,0 +1,144 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/kstack.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Static tracepoints.
+
+   TRACE() writes a fixed-size binary record into the current
+   CPU's ring buffer.  Unlike printf(), it takes no lock and
+   does no I/O, so it barely perturbs the timing it is used to
+   study.  When a ring fills up, the oldest records are
+   overwritten.
+
+   A record's slot is claimed with an atomic increment of the
+   ring's head, so an interrupt handler that traces while the
+   code it interrupted is in the middle of writing a record
+   just takes the next slot.
+
+   The "dump-trace FILE" action writes the records to a file for
+   utils/pintos-trace to print. */
+bool trace_enabled;
+
+const char *trace_event_names[TRACE_EVENT_CNT] =
+  {
+    "switch",
+    "page-fault",
+    "evict",
+    "disk-start",
+    "disk-done",
+    "syscall-enter",
+    "syscall-exit",
+  };
+
+/* Pages of records per CPU. */
+#define TRACE_PAGES 16
+
+/* Records per CPU. */
+#define TRACE_RECORDS (TRACE_PAGES * PGSIZE / sizeof (struct trace_record))
+
+/* A CPU's trace records. */
+struct trace_ring
+  {
+    struct trace_record *records; /* TRACE_RECORDS entries. */
+    volatile uint32_t head;     /* # of records ever claimed. */
+  };
+
+static struct trace_ring rings[CPU_MAX];
+
+/* Allocates a ring buffer for each CPU.  Tracing starts
+   as soon as this returns. */
+void
+trace_init (void)
+{
+  int i;
+
+  if (!trace_enabled)
+    return;
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      rings[i].records = palloc_get_multiple (0, TRACE_PAGES);
+      if (rings[i].records == NULL)
+        PANIC ("trace: out of memory for records");
+    }
+}
+
+/* Records EVENT with arguments A and B.  Use TRACE() instead of
+   calling this directly. */
+void
+trace_record (enum trace_event event, uint32_t a, uint32_t b)
+{
+  struct thread *t;
+  struct trace_ring *r;
+  struct trace_record *rec;
+  uint32_t *esp;
+
+  /* Same as running_thread() in thread.c.  thread_current()
+     would reject a thread in the middle of being switched out. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  t = kstack_owner (esp);
+
+  r = &rings[t->cpu->id];
+  if (r->records == NULL)
+    return;
+  rec = &r->records[__sync_fetch_and_add (&r->head, 1) % TRACE_RECORDS];
+  rec->tsc = cpu_cycles ();
+  rec->tid = t->tid;
+  rec->event = event;
+  rec->cpu = t->cpu->id;
+  rec->arg[0] = a;
+  rec->arg[1] = b;
+}
+
+/* Returns the number of records held, over all CPUs. */
+size_t
+trace_record_cnt (void)
+{
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++)
+    cnt += rings[i].head < TRACE_RECORDS ? rings[i].head : TRACE_RECORDS;
+  return cnt;
+}
+
+/* Copies the record with index IDX, which must be less than
+   trace_record_cnt(), into *REC.  Records are ordered by CPU,
+   then oldest first.  Tracing should be stopped while the
+   records are read. */
+void
+trace_get (size_t idx, struct trace_record *rec)
+{
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      struct trace_ring *r = &rings[i];
+      size_t cnt = r->head < TRACE_RECORDS ? r->head : TRACE_RECORDS;
+      if (idx < cnt)
+        {
+          *rec = r->records[(r->head - cnt + idx) % TRACE_RECORDS];
+          return;
+        }
+      idx -= cnt;
+    }
+  NOT_REACHED ();
+}
+
+/* Prints tracing statistics. */
+void
+trace_print_stats (void)
+{
+  unsigned long long claimed = 0;
+  int i;
+
+  if (!trace_enabled)
+    return;
+  for (i = 0; i < CPU_MAX; i++)
+    claimed += rings[i].head;
+  printf ("Trace: %llu records, %zu kept\n", claimed, trace_record_cnt ());
+}
@@ -0,0 +1,56 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Trace events.  Keep trace_event_names[] in trace.c in the same
+   order. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* Context switch: prev tid, next tid. */
+    TRACE_PAGE_FAULT,           /* Page fault: address, error code. */
+    TRACE_EVICT,                /* Frame evicted: user page, owner tid. */
+    TRACE_DISK_START,           /* Disk I/O issued: sector, write? */
+    TRACE_DISK_DONE,            /* Disk I/O completed: sector, write? */
+    TRACE_SYSCALL_ENTER,        /* System call: number, 0. */
+    TRACE_SYSCALL_EXIT,         /* System call return: number, eax. */
+    TRACE_EVENT_CNT
+  };
+
+/* One trace record.  This is also the on-disk format written by
+   the "dump-trace" action; see fsutil_dump_trace(). */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    int32_t tid;                /* Running thread. */
+    uint16_t event;             /* enum trace_event. */
+    uint16_t cpu;               /* CPU id. */
+    uint32_t arg[2];            /* Event-specific arguments. */
+  };
+
+/* Whether tracepoints record anything.  Controlled by kernel
+   command-line option "-trace". */
+extern bool trace_enabled;
+
+extern const char *trace_event_names[TRACE_EVENT_CNT];
+
+/* Records EVENT with arguments A and B, if tracing is on.  The
+   arguments are not evaluated if it is off.  Safe to use in any
+   context, including interrupt handlers and the scheduler. */
+#define TRACE(EVENT, A, B)                                      \
+        do                                                      \
+          {                                                     \
+            if (trace_enabled)                                  \
+              trace_record ((EVENT), (uint32_t) (A), (uint32_t) (B)); \
+          }                                                     \
+        while (0)
+
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t a, uint32_t b);
+size_t trace_record_cnt (void);
+void trace_get (size_t idx, struct trace_record *);
+void trace_print_stats (void);
+
+#endif /* threads/trace.h */
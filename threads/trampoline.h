@@ -0,0 +1,15 @@
+#ifndef THREADS_TRAMPOLINE_H
+#define THREADS_TRAMPOLINE_H
+
+/* Physical address to which cpu_start_aps() copies the
+   trampoline, in low memory that nothing else uses once the
+   kernel is running.  Must be page-aligned and below 1 MB. */
+#define TRAMPOLINE_BASE 0x8000
+
+#ifndef __ASSEMBLER__
+/* Application processor startup code, in trampoline.S. */
+extern char trampoline_start[], trampoline_end[];
+extern char tr_esp[], tr_cr3[];
+#endif
+
+#endif /* threads/trampoline.h */
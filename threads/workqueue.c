@@ -0,0 +1,176 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Work queues.
+
+   Interrupt handlers must be short, because interrupts stay off
+   while they run.  A handler with more to do can instead fill in
+   a struct work and queue it with work_queue(), which is safe to
+   call from any context, and a kernel thread runs the function
+   later with interrupts on.
+
+   There is one queue, and one worker thread, per priority.
+   Queueing pushes onto the queue's stack of pending work with a
+   compare-and-swap, so it never takes a lock or turns interrupts
+   off, except to wake the worker when the stack was empty.  The
+   worker takes the whole stack with a single exchange and runs
+   it oldest first. */
+struct workqueue
+  {
+    const char *name;           /* Worker thread name. */
+    int priority;               /* Worker thread priority. */
+    struct work *volatile pending; /* Stack of queued work, newest first. */
+    struct thread *worker;      /* Worker thread. */
+    bool sleeping;              /* Worker blocked waiting for work? */
+    unsigned queued_cnt;        /* # of items queued. */
+    unsigned run_cnt;           /* # of items run. */
+  };
+
+static struct workqueue queues[WORK_PRIO_CNT] =
+  {
+    { .name = "work-high", .priority = PRI_MAX },
+    { .name = "work-normal", .priority = PRI_DEFAULT },
+    { .name = "work-low", .priority = PRI_MIN },
+  };
+
+static thread_func worker_thread NO_RETURN;
+
+/* Starts the worker threads.  Must be called after
+   thread_start() and before the first call to work_queue(). */
+void
+workqueue_init (void)
+{
+  int i;
+
+  for (i = 0; i < WORK_PRIO_CNT; i++)
+    {
+      struct workqueue *wq = &queues[i];
+      tid_t tid = thread_create (wq->name, wq->priority, worker_thread, wq);
+      ASSERT (tid != TID_ERROR);
+    }
+}
+
+/* Initializes W to call FUNC with AUX when it runs. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->next = NULL;
+  w->func = func;
+  w->aux = aux;
+  w->pending = 0;
+}
+
+/* Queues W to run on the worker thread for PRIO.  Returns true
+   if W was queued, false if it was already pending.
+
+   May be called from an interrupt handler. */
+bool
+work_queue (struct work *w, enum work_prio prio)
+{
+  struct workqueue *wq;
+  struct work *head;
+
+  ASSERT (w != NULL);
+  ASSERT (prio < WORK_PRIO_CNT);
+
+  if (__sync_lock_test_and_set (&w->pending, 1))
+    return false;
+
+  wq = &queues[prio];
+  do
+    {
+      head = wq->pending;
+      w->next = head;
+    }
+  while (!__sync_bool_compare_and_swap (&wq->pending, head, w));
+  __sync_fetch_and_add (&wq->queued_cnt, 1);
+
+  /* Only the first item queued after the worker emptied the
+     stack needs to wake it. */
+  if (head == NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (wq->sleeping)
+        {
+          wq->sleeping = false;
+          thread_unblock (wq->worker);
+        }
+      intr_set_level (old_level);
+    }
+  return true;
+}
+
+/* Prints work queue statistics. */
+void
+workqueue_print_stats (void)
+{
+  int i;
+
+  for (i = 0; i < WORK_PRIO_CNT; i++)
+    printf ("Workqueue %s: %u queued, %u run\n",
+            queues[i].name, queues[i].queued_cnt, queues[i].run_cnt);
+}
+
+/* Takes all of WQ's pending work and returns it oldest first, or
+   a null pointer if there is none. */
+static struct work *
+take_pending (struct workqueue *wq)
+{
+  struct work *w = __sync_lock_test_and_set (&wq->pending, NULL);
+  struct work *list = NULL;
+
+  while (w != NULL)
+    {
+      struct work *next = w->next;
+      w->next = list;
+      list = w;
+      w = next;
+    }
+  return list;
+}
+
+/* Worker thread for the work queue WQ_. */
+static void
+worker_thread (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  wq->worker = thread_current ();
+  for (;;)
+    {
+      struct work *w = take_pending (wq);
+
+      if (w == NULL)
+        {
+          enum intr_level old_level = intr_disable ();
+          if (wq->pending == NULL)
+            {
+              wq->sleeping = true;
+              thread_block ();
+            }
+          intr_set_level (old_level);
+          continue;
+        }
+
+      while (w != NULL)
+        {
+          struct work *next = w->next;
+          work_func *func = w->func;
+          void *aux = w->aux;
+
+          /* After this, W may be queued again, even by FUNC. */
+          barrier ();
+          w->pending = 0;
+          func (aux);
+          wq->run_cnt++;
+          w = next;
+        }
+    }
+}
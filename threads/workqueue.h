@@ -0,0 +1,37 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <stdbool.h>
+
+/* Work queue priorities.  Each has its own worker thread, which
+   runs at the thread priority given in workqueue.c. */
+enum work_prio
+  {
+    WORK_HIGH,                  /* Urgent work, ahead of everything. */
+    WORK_NORMAL,                /* Competes with ordinary threads. */
+    WORK_LOW,                   /* Runs only when nothing else can. */
+    WORK_PRIO_CNT
+  };
+
+typedef void work_func (void *aux);
+
+/* A deferred function call.
+
+   The caller owns the memory, which must stay valid until the
+   function starts running.  A work item may be queued again as
+   soon as its function has started, including by the function
+   itself. */
+struct work
+  {
+    struct work *next;          /* Next in a queue's pending stack. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Its argument. */
+    volatile int pending;       /* Queued but not yet started? */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct work *, enum work_prio);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
@@ -8,6 +8,7 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/palloc.h"
+#include "threads/trace.h"
 
 #include "vm/page.h"
 #include "vm/frame.h"
@@ -17,8 +18,6 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 
-#define MAX_USER_STACK 8*1024*1024
-
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
@@ -59,8 +58,7 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
+  /* #NM is handled by threads/fpu.c, which switches FPU state. */
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -68,6 +66,10 @@ exception_init (void)
   intr_register_int (19, 0, INTR_ON, kill,
                      "#XF SIMD Floating-Point Exception");
 
+  /* A double fault leaves the faulting stack unusable, so it
+     switches to a task of its own in tss.c. */
+  intr_register_task (8, SEL_DFTSS, "#DF Double Fault Exception");
+
   /* Most exceptions can be handled with interrupts turned on.
      We need to disable interrupts for page faults because the
      fault address is stored in CR2 and needs to be preserved. */
@@ -149,6 +151,7 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  TRACE (TRACE_PAGE_FAULT, fault_addr, f->error_code);
 
 
 
@@ -178,67 +181,54 @@ page_fault (struct intr_frame *f)
 	/* check the the pointer is valid */
 	void* fault_page = pg_round_down(fault_addr); // upage.
 	struct thread *cur = thread_current();
-	if(not_present){
-		// ޸𸮿  ʴ° ϴ process page_table ˻
-		struct pte* pte = find_page(cur->page_table, fault_page);
-		if(pte){
-			//ٽ memory εѴ(swap_in)
-			void *kpage = get_page(PAL_USER | PAL_ZERO);
-			if(pte->loc == SWP){
-				//Swap  Swap In
+	if(not_present && fault_addr < PHYS_BASE){
+		struct pt *pt = cur->process->page_table;
+		uint32_t *pd = cur->process->pagedir;
+		bool installed = false, resolved = false;
+		struct pte *pte;
+		void *kpage;
+
+		//a write just below the stack pointer grows the stack by a
+		//zero page (4 for push, 32 for pusha)
+		if(write && fault_addr >= PHYS_BASE - MAX_USER_STACK){
+			void *esp = user ? f->esp : cur->esp;
+			if(esp <= fault_addr || esp - fault_addr == 4 || esp - fault_addr == 32)
+				reserve_pages(pt, fault_page, 1);
+		}
+
+		//get the frame before taking pt_lock: getting it may evict
+		//one of our own pages, which takes pt_lock too
+		kpage = get_page(PAL_USER | PAL_ZERO);
+
+		rwlock_acquire_write(&pt->pt_lock);
+		pte = find_page(pt, fault_page);
+		if(pte != NULL && pte->loc == MEM){
+			//another of our threads brought it in first
+			resolved = true;
+		}
+		else if(pte != NULL){
+			if(pte->loc == SWP)
 				swap_in(pte->disk_ind, kpage);
-			}
-			else if(pte->loc == NOZ){
-				//zero ƴ page  FILE о
+			else if(pte->loc == NOZ)
 				file_read_at (pte->file, kpage, pte->file_size, pte->ofs);
-			}
-			pte->paddr = kpage;
-			//install  Ŵ
-			install_page(fault_page, kpage, pte->writable);
-			pte->loc = MEM;
-			pagedir_set_dirty (cur->pagedir, fault_page, false);
-			return;
-		}
-		else{
-			// stack grow, writableѰ ϴ Ȯ
-			if(fault_addr < PHYS_BASE && fault_addr >= PHYS_BASE - MAX_USER_STACK && write){
-				void *esp = f->esp;
-				if(!user)
-					esp = cur->esp;
-//				printf("esp : %x\n", esp);
-				//check stack growth(4 push, 32 pusha  Ȯ)
-				if(esp <= fault_addr || esp - fault_addr == 4 || esp - fault_addr == 32){
-					//ο page Ҵؼ page table 
-					void *kaddr = get_page(PAL_USER);
-					install_page(fault_page, kaddr, true);
-
-					struct pte *pte = make_page_entry(fault_page, kaddr);
-					pte->writable = true;
-					pte->loc = MEM;
-					insert_page(cur->page_table, pte);
-					//stack writable
-					return;
-				}
-				else{
-					// stack 
-					//f->eip = f->eax;
-					f->eax = -1;
-					thread_current()->child_exit_status=-1;
-					printf("%s: exit(%d)\n", thread_name(), -1);
-					thread_exit();
-					return;
-				}
-			}
-			else{
-				//USER STACK ġ ʰ Ǵ Kernel stack 
-				//f->eip = f->eax;
-				f->eax = -1;
-				thread_current()->child_exit_status=-1;
-				printf("%s: exit(%d)\n", thread_name(), -1);
-				thread_exit();
-				return;
+			if(pagedir_set_page(pd, fault_page, kpage, pte->writable)){
+				pte->paddr = kpage;
+				pte->loc = MEM;
+				pagedir_set_dirty(pd, fault_page, false);
+				installed = resolved = true;
 			}
 		}
+		rwlock_release_write(&pt->pt_lock);
+
+		//register the frame only now: frame_lock comes before pt_lock
+		//(see vm/page.h), and the frame must not be evictable before
+		//its page is in
+		if(installed)
+			insert_frame(make_frame_entry(fault_page, kpage, cur->process));
+		else
+			palloc_free_page(kpage);
+		if(resolved)
+			return;
 	}
 	// 
 	//f->eip = f->eax;
@@ -13,6 +13,7 @@
 
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "threads/arena.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -24,51 +25,208 @@
 #include <list.h>
 
 #include "userprog/syscall.h"
+#include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_thread NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
-static struct semaphore wait_execute;
-struct thread *findthread(struct list *elist, tid_t t){
-	struct list_elem *e;
-	struct thread *ex;
-	if(!list_empty(elist)){
-		for(e = list_begin(elist); e!=list_end(elist); e=list_next(e)){
-			ex = list_entry(e, struct thread, e_elem);
-				if(ex->tid == t)
-					return ex;
-		}
-	}
-	return NULL;
+/* Exit status of a child process.  It is shared by the child,
+	 which fills it in when it exits, and its parent, which keeps
+	 it in its children list and hash until it waits for the
+	 child, so that neither has to search for the other. */
+struct child_status
+{
+	tid_t tid;                  /* Child's thread id. */
+	int exit_status;            /* Valid once exited is up. */
+	struct semaphore exited;    /* Upped when the child exits. */
+	int refs;                   /* Parent and/or child still using it. */
+	struct list_elem elem;      /* In parent's children. */
+	struct hash_elem helem;     /* In parent's children_by_tid. */
+};
+
+/* Passed from process_execute() to start_process().  Lives on
+	 the parent's stack until the child has finished loading. */
+struct exec_info
+{
+	char *file_name;            /* Command line, in a page. */
+	struct child_status *status; /* Child's exit status record. */
+	struct semaphore loaded;    /* Upped when load finishes. */
+	bool success;               /* Did load succeed? */
+};
+
+/* User threads.
+
+	 A process starts out as one kernel thread, the process thread,
+	 which owns the page directory, supplemental page table, open
+	 files and mappings.  thread_create() adds user threads, which
+	 are kernel threads of their own that use the process thread's
+	 address space and files through their `process' member.  The
+	 process thread therefore outlives them: when it exits, it
+	 waits for the others to go first.
+
+	 Each user thread gets a stack of UTHREAD_STACK_PAGES pages in
+	 a slot below the process thread's stack.  The lowest page of
+	 the slot stays out of the page table, so that an overflow
+	 faults instead of running into the next stack.
+
+	 exit() in any thread ends the whole process.  The other
+	 threads stop the next time they would return to user mode,
+	 which process_check_exit() checks on every interrupt;
+	 threads sleeping in futex_wait() are woken for it. */
+#define UTHREAD_STACK_PAGES 16
+#define UTHREAD_MAX 64
+#define UTHREAD_STACK_TOP ((uint8_t *) PHYS_BASE - MAX_USER_STACK)
+
+/* The threads of a process that has used thread_create() or a
+	 futex.  They all point to it, and the last to leave frees it. */
+struct thread_group
+{
+	struct lock lock;           /* Protects the members below. */
+	struct list joinable;       /* Records of threads not yet joined. */
+	struct list futex_waiters;  /* Threads in futex_wait(). */
+	int running;                /* User threads that have not exited. */
+	bool exiting;               /* Is the process going away? */
+	struct semaphore gone;      /* Upped when exiting and none running. */
+	int refs;                   /* Threads still pointing here. */
+};
+
+/* A thread sleeping in futex_wait().  Lives on its stack. */
+struct futex_waiter
+{
+	int *addr;                  /* User address slept on. */
+	struct semaphore wake;      /* Upped by futex_wake(). */
+	struct list_elem elem;      /* In group's futex_waiters. */
+};
+
+/* Passed from process_thread_create() to start_thread().  Lives
+	 on the creator's stack until the new thread has started. */
+struct thread_info
+{
+	struct thread *process;     /* Process thread. */
+	void (*eip) (void);         /* Where to start in user mode. */
+	void *arg0, *arg1;          /* EIP's arguments. */
+	uint8_t *stack;             /* Lowest mapped page of the stack. */
+	struct child_status *status; /* New thread's join record. */
+	struct semaphore started;   /* Upped when the thread is set up. */
+};
+
+static unsigned
+child_hash(const struct hash_elem *e, void *aux UNUSED){
+	const struct child_status *cs = hash_entry(e, struct child_status, helem);
+	return hash_int(cs->tid);
+}
+
+static bool
+child_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED){
+	return hash_entry(a, struct child_status, helem)->tid
+		< hash_entry(b, struct child_status, helem)->tid;
 }
-void wakeupwaiting(int status){
+
+//drops one reference to CS and frees it after the last one
+static void
+release_child_status(struct child_status *cs){
+	enum intr_level old_level = intr_disable();
+	int refs = --cs->refs;
+	intr_set_level(old_level);
+	if(refs == 0)
+		free(cs);
+}
+
+//returns the current thread's record of child TID, or NULL
+static struct child_status *
+find_child(tid_t tid){
 	struct thread *cur = thread_current();
-	struct list *elist = &execute_list;
-	struct list_elem *e;
-	struct thread *ex=NULL;
-	bool end=false;
-	if(!list_empty(elist)){
-		for(e = list_begin(elist); e!=list_end(elist); e=list_next(e)){
-			ex = list_entry(e, struct thread, e_elem);
-			if(ex->waitfor == cur->tid){
-				end = true;
-				break;
-			}
-		}
-		if(end){
-			list_remove(&cur->e_elem);
-		}
-		else{
-			//nothing found for waking up
-			list_remove(&cur->e_elem);
-			return;
-		}
-//		printf("%d's exit stats is %d\n", ex->tid, status);
-		ex->waitfor = -1;
-		ex->child_exit_status = status;
-//		printf("%d wake up\n", ex->tid);
-		sema_up(&ex->wait);
+	struct child_status key;
+	struct hash_elem *e;
+	if(!cur->children_hashed)
+		return NULL;
+	key.tid = tid;
+	e = hash_find(&cur->children_by_tid, &key.helem);
+	return e != NULL ? hash_entry(e, struct child_status, helem) : NULL;
+}
+
+//returns the current process's thread group, creating it if need be
+static struct thread_group *
+get_group(void){
+	struct thread *proc = thread_current()->process;
+	struct thread_group *g = proc->group;
+	if(g == NULL){
+		//only the process thread can get here, so there is no race
+		g = malloc(sizeof *g);
+		if(g == NULL)
+			return NULL;
+		lock_init(&g->lock);
+		list_init(&g->joinable);
+		list_init(&g->futex_waiters);
+		g->running = 0;
+		g->exiting = false;
+		sema_init(&g->gone, 0);
+		g->refs = 1;
+		proc->group = g;
 	}
+	return g;
+}
+
+//drops one reference to G and frees it after the last one
+static void
+release_group(struct thread_group *g){
+	enum intr_level old_level = intr_disable();
+	int refs = --g->refs;
+	intr_set_level(old_level);
+	if(refs == 0)
+		free(g);
+}
+
+//makes the threads of PROC's process stop short of user mode,
+//with exit STATUS unless an earlier exit already decided it
+static void
+kill_group(struct thread *proc, int status){
+	struct thread_group *g = proc->group;
+	lock_acquire(&g->lock);
+	if(!g->exiting){
+		g->exiting = true;
+		proc->child_exit_status = status;
+	}
+	//sleepers have to wake up to notice
+	while(!list_empty(&g->futex_waiters)){
+		struct list_elem *e = list_pop_front(&g->futex_waiters);
+		sema_up(&list_entry(e, struct futex_waiter, elem)->wake);
+	}
+	lock_release(&g->lock);
+}
+
+//counts a user thread out of G and drops its reference
+static void
+leave_group(struct thread_group *g){
+	bool last;
+	lock_acquire(&g->lock);
+	last = --g->running == 0 && g->exiting;
+	lock_release(&g->lock);
+	if(last)
+		sema_up(&g->gone);
+	release_group(g);
+}
+
+//ends the process thread's group once the user threads are gone
+static void
+end_group(void){
+	struct thread *curr = thread_current();
+	struct thread_group *g = curr->group;
+	bool wait;
+
+	kill_group(curr, curr->child_exit_status);
+	lock_acquire(&g->lock);
+	wait = g->running > 0;
+	lock_release(&g->lock);
+	if(wait)
+		sema_down(&g->gone);
+	while(!list_empty(&g->joinable)){
+		struct list_elem *e = list_pop_front(&g->joinable);
+		release_child_status(list_entry(e, struct child_status, elem));
+	}
+	curr->group = NULL;
+	release_group(g);
 }
 
 /* Starts a new thread running a user program loaded from
@@ -78,29 +236,62 @@ void wakeupwaiting(int status){
 	tid_t
 process_execute (const char *file_name) 
 {
+	struct thread *cur = thread_current();
+	struct exec_info info;
+	struct child_status *cs;
+	size_t mark, len;
 	char *fn_copy;
 	tid_t tid;
 
+	if(!cur->children_hashed){
+		if(!hash_init(&cur->children_by_tid, child_hash, child_less, NULL))
+			return TID_ERROR;
+		cur->children_hashed = true;
+	}
+
 	/* Make a copy of FILE_NAME.
-		 Otherwise there's a race between the caller and load(). */
-	fn_copy = palloc_get_page (0);
+		 Otherwise there's a race between the caller and load().
+		 A command line too long for the arena fails rather than
+		 being cut short. */
+	mark = arena_mark ();
+	len = strlen (file_name) + 1;
+	fn_copy = arena_alloc (len);
 	if (fn_copy == NULL)
 		return TID_ERROR;
-	strlcpy (fn_copy, file_name, 512);
+	memcpy (fn_copy, file_name, len);
 
-	sema_init(&wait_execute, 0);
-	/* Create a new thread to execute FILE_NAME. */
-	tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+	cs = malloc(sizeof *cs);
+	if(cs == NULL){
+		arena_release (mark);
+		return TID_ERROR;
+	}
+	cs->exit_status = -1;
+	sema_init(&cs->exited, 0);
+	cs->refs = 2;
+
+	info.file_name = fn_copy;
+	info.status = cs;
+	sema_init(&info.loaded, 0);
+	info.success = false;
 
-	//it's for first process
-	if(list_empty(&execute_list)){
-		list_push_back(&execute_list, &thread_current()->e_elem);
+	/* Create a new thread to execute FILE_NAME. */
+	tid = thread_create (file_name, PRI_DEFAULT, start_process, &info);
+	if (tid == TID_ERROR){
+		arena_release (mark);
+		free(cs);
+		return TID_ERROR;
 	}
 
-	//wait for just execution
-	sema_down(&wait_execute);
-	if (tid == TID_ERROR)
-		palloc_free_page (fn_copy);
+	//wait for just the load; the child is done with fn_copy by then
+	sema_down(&info.loaded);
+	arena_release (mark);
+	if(!info.success){
+		release_child_status(cs);
+		return TID_ERROR;
+	}
+	cs->tid = tid;
+	list_push_back(&cur->children, &cs->elem);
+	hash_insert(&cur->children_by_tid, &cs->helem);
 	return tid;
 }
 static void 
@@ -119,20 +310,21 @@ pushespaddr(void **esp, unsigned int value){
 /* A thread function that loads a user process and makes it start
 	 running. */
 	static void
-start_process (void *f_name)
+start_process (void *info_)
 {
-	char *file_name = f_name;
+	struct exec_info *info = info_;
+	char *file_name = info->file_name;
 	struct intr_frame if_;
 	bool success;
 	char *save_ptr, *token;
 	char *tempaddr;
-	char *argv = palloc_get_page(0);
+	size_t mark = arena_mark();
+	char *argv = arena_alloc(strlen(file_name)+1);
 	int argc = 0;
 	int argvlen = 0;
 	int i;
-  
 
-	list_push_back(&execute_list, &thread_current()->e_elem);
+	thread_current()->exit_record = info->status;
 	/* Initialize interrupt frame and load executable. */
 	memset (&if_, 0, sizeof if_);
 	if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -140,7 +332,7 @@ start_process (void *f_name)
 	if_.eflags = FLAG_IF | FLAG_MBS;
 
 	token = strtok_r(file_name, " ", &save_ptr);
-	if(token == NULL)
+	if(token == NULL || argv == NULL)
 		success = false;
 	else
 		success = load (token, &if_.eip, &if_.esp);
@@ -181,20 +373,15 @@ start_process (void *f_name)
 	}
 
 	/* If load failed, quit. */
-	palloc_free_page(argv);
-	palloc_free_page (file_name);
+	arena_release(mark);
 
+	//info is gone once the parent is woken up
+	info->success = success;
+	sema_up(&info->loaded);
 	if (!success){
-//		wakeupwaiting(-1);
 		thread_current()->child_exit_status=-1;
-		sema_up(&wait_execute);
 		thread_exit ();
 	}
-	else{
-		sema_up(&wait_execute);
-//		printf("thread %d go to sleep\n", thread_current()->tid);
-		sema_down(&thread_current()->wait);
-	}
 
 	//debuging
 //	print_page_table(thread_current()->page_table);
@@ -221,25 +408,266 @@ start_process (void *f_name)
 	 This function will be implemented in problem 2-2.  For now, it
 	 does nothing. */
 	int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
-	//	while(1);
 	struct thread *cur = thread_current();
-	cur->waitfor = child_tid;
-	struct thread *child = findthread(&execute_list, child_tid);
-	if(child->parent_id != NULL && child->parent_id->tid != cur->tid){
-					//check child relationship
-					return -1;
+	struct child_status *cs = find_child(child_tid);
+	int status;
+
+	//not my child, or already waited for
+	if(cs == NULL)
+		return -1;
+	sema_down(&cs->exited);
+	status = cs->exit_status;
+	list_remove(&cs->elem);
+	hash_delete(&cur->children_by_tid, &cs->helem);
+	release_child_status(cs);
+	return status;
+}
+
+/* Starts a user thread in the current process, running from EIP
+	 in user mode with ARG0 and ARG1 as its arguments.  Returns the
+	 new thread's id, or TID_ERROR if it cannot be created. */
+	tid_t
+process_thread_create (void (*eip) (void), void *arg0, void *arg1)
+{
+	struct thread *proc = thread_current()->process;
+	struct thread_group *g = get_group();
+	struct thread_info info;
+	struct child_status *cs;
+	enum intr_level old_level;
+	uint8_t *stack = NULL;
+	tid_t tid;
+	int i;
+
+	if(g == NULL)
+		return TID_ERROR;
+
+	//a live thread's stack slot is still in the page table
+	for(i = 0; i < UTHREAD_MAX && stack == NULL; i++){
+		uint8_t *slot = UTHREAD_STACK_TOP - (i + 1) * UTHREAD_STACK_PAGES * PGSIZE;
+		if(reserve_pages(proc->page_table, slot + PGSIZE, UTHREAD_STACK_PAGES - 1))
+			stack = slot + PGSIZE;
 	}
-//	printf("%d wait %d\n", cur->tid, child_tid);
-	while(cur->waitfor > 0){
-		sema_up(&child->wait);
-		sema_down(&cur->wait);
+	if(stack == NULL)
+		return TID_ERROR;
+
+	cs = malloc(sizeof *cs);
+	if(cs == NULL){
+		release_pages(proc->page_table, proc->pagedir, stack, UTHREAD_STACK_PAGES - 1);
+		return TID_ERROR;
+	}
+	cs->exit_status = 0;
+	sema_init(&cs->exited, 0);
+	cs->refs = 2;
+
+	lock_acquire(&g->lock);
+	if(g->exiting){
+		lock_release(&g->lock);
+		free(cs);
+		release_pages(proc->page_table, proc->pagedir, stack, UTHREAD_STACK_PAGES - 1);
+		return TID_ERROR;
+	}
+	g->running++;
+	lock_release(&g->lock);
+	old_level = intr_disable();
+	g->refs++;
+	intr_set_level(old_level);
+
+	info.process = proc;
+	info.eip = eip;
+	info.arg0 = arg0;
+	info.arg1 = arg1;
+	info.stack = stack;
+	info.status = cs;
+	sema_init(&info.started, 0);
+	tid = thread_create(proc->name, thread_get_priority(), start_thread, &info);
+	if(tid == TID_ERROR){
+		leave_group(g);
+		free(cs);
+		release_pages(proc->page_table, proc->pagedir, stack, UTHREAD_STACK_PAGES - 1);
+		return TID_ERROR;
+	}
+	sema_down(&info.started);
+
+	cs->tid = tid;
+	lock_acquire(&g->lock);
+	list_push_back(&g->joinable, &cs->elem);
+	lock_release(&g->lock);
+	return tid;
+}
+
+/* A thread function that makes the new thread a user thread of
+	 INFO_'s process and starts it in user mode. */
+	static void
+start_thread (void *info_)
+{
+	struct thread_info *info = info_;
+	struct thread *t = thread_current();
+	struct intr_frame if_;
+	uint32_t *esp;
+
+	t->process = info->process;
+	t->group = info->process->group;
+	t->pagedir = info->process->pagedir;
+	t->ustack = info->stack;
+	t->exit_record = info->status;
+	process_activate();
+
+	memset (&if_, 0, sizeof if_);
+	if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+	if_.cs = SEL_UCSEG;
+	if_.eflags = FLAG_IF | FLAG_MBS;
+	if_.eip = info->eip;
+
+	//arguments and a null return address, as if EIP had been called
+	esp = (uint32_t *)(info->stack + (UTHREAD_STACK_PAGES - 1) * PGSIZE);
+	*--esp = (uint32_t)info->arg1;
+	*--esp = (uint32_t)info->arg0;
+	*--esp = 0;
+	if_.esp = esp;
+
+	//info is gone once the creator is woken up
+	sema_up(&info->started);
+	asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+	NOT_REACHED ();
+}
+
+/* Waits for user thread TID of the current process to exit.
+	 Returns 0 once it has, or -1 at once if TID is not a thread of
+	 this process, is the caller, or has already been joined. */
+	int
+process_thread_join (tid_t tid)
+{
+	struct thread_group *g = thread_current()->group;
+	struct child_status *cs = NULL;
+	struct list_elem *e;
+
+	if(g == NULL || tid == thread_tid())
+		return -1;
+	lock_acquire(&g->lock);
+	for(e = list_begin(&g->joinable); e != list_end(&g->joinable); e = list_next(e)){
+		if(list_entry(e, struct child_status, elem)->tid == tid){
+			cs = list_entry(e, struct child_status, elem);
+			list_remove(e);
+			break;
+		}
 	}
-	cur->waitfor = -1;
-//	thread_set_priority(0);
-//	printf("wait state : %d\n", cur->child_exit_status);
-	return cur->child_exit_status;
+	lock_release(&g->lock);
+	if(cs == NULL)
+		return -1;
+	sema_down(&cs->exited);
+	release_child_status(cs);
+	return 0;
+}
+
+/* Sleeps until woken by process_futex_wake() on ADDR, a user
+	 address, if *ADDR still equals VAL.  Returns 0 after sleeping,
+	 or -1 at once if *ADDR differs or the process is exiting. */
+	int
+process_futex_wait (int *addr, int val)
+{
+	struct thread_group *g = get_group();
+	struct futex_waiter w;
+
+	if(g == NULL)
+		return -1;
+	//fault the word in, or die trying, before taking the lock
+	if(*(volatile int *)addr != val)
+		return -1;
+	lock_acquire(&g->lock);
+	if(g->exiting || *(volatile int *)addr != val){
+		lock_release(&g->lock);
+		return -1;
+	}
+	w.addr = addr;
+	sema_init(&w.wake, 0);
+	list_push_back(&g->futex_waiters, &w.elem);
+	lock_release(&g->lock);
+	sema_down(&w.wake);
+	return 0;
+}
+
+/* Wakes up to CNT threads sleeping on ADDR in
+	 process_futex_wait(), oldest first.  Returns how many woke. */
+	int
+process_futex_wake (int *addr, int cnt)
+{
+	struct thread_group *g = thread_current()->group;
+	struct list_elem *e;
+	int woken = 0;
+
+	if(g == NULL)
+		return 0;
+	lock_acquire(&g->lock);
+	e = list_begin(&g->futex_waiters);
+	while(e != list_end(&g->futex_waiters) && woken < cnt){
+		struct futex_waiter *w = list_entry(e, struct futex_waiter, elem);
+		//W is gone as soon as it wakes
+		e = list_next(e);
+		if(w->addr == addr){
+			list_remove(&w->elem);
+			sema_up(&w->wake);
+			woken++;
+		}
+	}
+	lock_release(&g->lock);
+	return woken;
+}
+
+/* Ends the current thread if its process is exiting.  Called by
+	 intr_handler() on the way back to user mode. */
+	void
+process_check_exit (void)
+{
+	struct thread_group *g = thread_current()->group;
+
+	if(g != NULL && g->exiting){
+		intr_enable();
+		thread_exit();
+	}
+}
+
+//reports my exit status through my record, and drops my children's
+static void
+report_exit(struct thread *curr){
+	struct list_elem *e;
+
+	//report my exit status to my parent
+	if(curr->exit_record != NULL){
+		curr->exit_record->exit_status = curr->child_exit_status;
+		sema_up(&curr->exit_record->exited);
+		release_child_status(curr->exit_record);
+		curr->exit_record = NULL;
+	}
+	//my children will not be waited for anymore
+	while(!list_empty(&curr->children)){
+		e = list_pop_front(&curr->children);
+		release_child_status(list_entry(e, struct child_status, elem));
+	}
+	if(curr->children_hashed){
+		hash_destroy(&curr->children_by_tid, NULL);
+		curr->children_hashed = false;
+	}
+}
+
+//ends a user thread; unless it called thread_exit(), its
+//process goes with it
+static void
+exit_thread(void){
+	struct thread *curr = thread_current();
+	struct thread *proc = curr->process;
+	struct thread_group *g = curr->group;
+
+	release_pages(proc->page_table, proc->pagedir, curr->ustack, UTHREAD_STACK_PAGES - 1);
+	report_exit(curr);
+	if(!curr->thread_exited)
+		kill_group(proc, curr->child_exit_status);
+	//the page directory may be destroyed as soon as I leave
+	curr->pagedir = NULL;
+	pagedir_activate(NULL);
+	curr->group = NULL;
+	leave_group(g);
 }
 
 /* Free the current process's resources. */
@@ -250,6 +678,14 @@ process_exit (void)
 	uint32_t *pd;
 	int i;
 
+	if(curr->process != curr){
+		exit_thread();
+		return;
+	}
+	//my user threads go first
+	if(curr->group != NULL)
+		end_group();
+
 	//mmap table ִ ͸ free
 	//߰ dirtyǾ ִ°  
 	struct list_elem *e;
@@ -260,7 +696,7 @@ process_exit (void)
 		sys_unmmap(curr, me);
 	}
 
-	wakeupwaiting(curr->child_exit_status);
+	report_exit(curr);
 	//close my fds
 	for(i=0; i<MAXFD; i++){
 		if((int)curr->fd_set[i] > 1){
@@ -274,7 +710,8 @@ process_exit (void)
 
 	// ̺ destroy
 	//⼭  frame pagedir element freeŴ
-	destroy_page_table(curr->page_table);
+	//the emptied page table is reused along with this thread's page
+	clear_page_table(curr->page_table);
 	/* Destroy the current process's page directory and switch back
 		 to the kernel-only page directory. */
 	pd = curr->pagedir;
@@ -631,6 +1068,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 			}
 		}
 		insert_page(thread_current()->page_table, pte);
+		//the frame goes in last: from then on it may be evicted
+		if(pte->loc == MEM)
+			insert_frame(make_frame_entry(upage, pte->paddr, thread_current()->process));
 		/* Advance. */
 		read_bytes -= page_read_bytes;
 		zero_bytes -= page_zero_bytes;
@@ -659,6 +1099,7 @@ setup_stack (void **esp)
 			pte->writable = true;
 			pte->loc = MEM;
 			insert_page(thread_current()->page_table, pte);
+			insert_frame(make_frame_entry(pte->vaddr, kpage, thread_current()->process));
 		}
 
 		if (success)
@@ -677,15 +1118,14 @@ setup_stack (void **esp)
 	 KPAGE should probably be a page obtained from the user pool
 	 with palloc_get_page().
 	 Returns true on success, false if UPAGE is already mapped or
-	 if memory allocation fails. */
+	 if memory allocation fails.
+	 The caller adds the frame to the frame table only after adding
+	 the page to the page table, since it may be evicted from then
+	 on. */
 bool
 install_page (void *upage, void *kpage, bool writable)
 {
-	struct thread *t = thread_current ();
-	
-	//page installҶ frame table ߰
-	struct fte *fte = make_frame_entry(upage, kpage, thread_current());
-	insert_frame(fte);
+	struct thread *t = thread_current ()->process;
 
 	/* Verify that there's not already a page at that virtual
 		 address, then map our page there. */
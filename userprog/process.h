@@ -5,14 +5,20 @@
 #include "threads/synch.h"
 #include <list.h>
 
+/* How far the initial thread's user stack may grow down from
+	 PHYS_BASE.  User thread stacks go below it. */
+#define MAX_USER_STACK (8 * 1024 * 1024)
+
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
-void wakeupwaiting(int);
-
-struct thread * findthread(struct list *, tid_t);
-
 bool install_page(void *, void *, bool);
 
+tid_t process_thread_create (void (*eip) (void), void *arg0, void *arg1);
+int process_thread_join (tid_t);
+int process_futex_wait (int *addr, int val);
+int process_futex_wake (int *addr, int cnt);
+void process_check_exit (void);
+
 #endif /* userprog/process.h */
@@ -11,8 +11,9 @@
 #include "devices/input.h"
 #include "threads/vaddr.h"
 
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include <string.h>
 #include <list.h>
 
@@ -25,12 +26,13 @@
 static void sysexit(int);
 static bool goodfileptr(void *);
 static bool goodfd(int);
-static int makeP_C(tid_t);
 
 static struct mmap_elem *find_mmap(struct list *,int);
+static struct kmem_cache *mmap_cache;
 static bool mmap_overlap_check(struct list *, void *);
 
 static void syscall_handler (struct intr_frame *);
+static void do_syscall (struct intr_frame *);
 
 struct mmap_elem* find_mmap(struct list *mlist, int fd){
 	struct list_elem *e;
@@ -59,31 +61,37 @@ bool mmap_overlap_check(struct list* mlist, void *addr){
 }
 
 void sys_unmmap(struct thread* cur, struct mmap_elem* me){
+	struct pt *pt = cur->page_table;
 	//find file pointer
 	int ofilesize = me->msize;
 	//unmap 
 	int last_page = ((ofilesize-1)/PGSIZE)+1;
 	void* addr = me->mstart;
 	while(last_page >0){
-		struct pte* pte = find_page(cur->page_table, addr);
+		struct pte* pte;
+		struct file *file;
+		int ofs, size;
+		rwlock_acquire_read(&pt->pt_lock);
+		pte = find_page(pt, addr);
 		if(pte == NULL){
 			printf("ERROR\n");
 			ASSERT(false);
 		}
+		file = pte->file;
+		ofs = pte->ofs;
+		size = pte->file_size;
+		rwlock_release_read(&pt->pt_lock);
 		// page 
+		//writing it back reads ADDR, which may fault it back in and
+		//take pt_lock, so the lock is not held here
 		if(pagedir_is_dirty(cur->pagedir, addr)){
-			file_write_at(pte->file, addr, pte->file_size, pte->ofs);
+			file_write_at(file, addr, size, ofs);
 		}
-		if(pte->loc == MEM){
-			//޸  allocate ޸ free Ŵ
-			free_page(cur->pagedir, addr);
-			delete_frame(find_frame(pte->paddr));
-		}
-		else if(pte->loc == SWP){
-			//Swap   Swap table free Ŵ
-			swap_free(pte->disk_ind);
-		}
-		delete_page(cur->page_table, pte);
+		rwlock_acquire_write(&pt->pt_lock);
+		pte = find_page(pt, addr);
+		delete_page(pt, pte);
+		rwlock_release_write(&pt->pt_lock);
+		release_page(cur->pagedir, pte);
 		//   
 		addr +=  PGSIZE;
 		last_page--;
@@ -96,6 +104,7 @@ syscall_init (void)
 {
 	sema_init(&filesys[0],1);
 	sema_init(&filesys[1],1);
+	mmap_cache = kmem_cache_create("mmap", sizeof(struct mmap_elem), NULL);
 	intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -105,7 +114,15 @@ getaddr(void *ptr){
 }
 
 	static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
+{
+	TRACE(TRACE_SYSCALL_ENTER, getaddr(f->esp), 0);
+	do_syscall(f);
+	TRACE(TRACE_SYSCALL_EXIT, getaddr(f->esp), f->eax);
+}
+
+	static void
+do_syscall (struct intr_frame *f) 
 {
 	int syscallnum = *((int *)f->esp);
 	thread_current()->esp = f->esp;
@@ -128,23 +145,12 @@ syscall_handler (struct intr_frame *f UNUSED)
 	else if(syscallnum == SYS_EXEC){
 		//this systemcall is about exec
 		const char *cmd_line = (const char *)getaddr(f->esp+0x04);
-		tid_t pid = process_execute(cmd_line);
-		f->eax = makeP_C(pid);
+		f->eax = process_execute(cmd_line);
 	}
 	else if(syscallnum == SYS_WAIT){
 		//this systemcall is about wait
+		//process_wait() rejects other processes' children and double waits
 		tid_t pid = (tid_t)getaddr(f->esp+0x04);
-		struct thread *pthread = findthread(&execute_list, pid);
-		if(pthread == NULL){
-			//there is no pid, that is double wait
-			f->eax = -1;
-			return;
-		}
-		else if(pthread->parent_id != thread_current()){
-			//this is not my child, so no duty for wait
-			f->eax=-1;
-			return;
-		}
 		f->eax = process_wait(pid); 
 	}
 	else if(syscallnum == SYS_CREATE){
@@ -183,7 +189,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 		const char *file = (const char *)getaddr(f->esp+0x04);
 		struct file *ofile = NULL;
 		int i;
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		if(!goodfileptr((void *)file)){	
 			sysexit(-1);
 			return;
@@ -214,7 +220,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 		//this systemcall is about filesize
 		int fd = getaddr(f->esp+0x4);
 		struct file* ofile;
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		if(!goodfd(fd)){
 			sysexit(-1);
 			return;
@@ -239,7 +245,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 		void * buf = (void *)getaddr(f->esp+0x8);
 		unsigned size = (unsigned)getaddr(f->esp+0xc);
 		struct file* ofile;
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		if(!goodfd(fd)){
 			sysexit(-1);
 			return;
@@ -279,7 +285,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 		const void * buf = (const void *)getaddr(f->esp+0x8);
 		unsigned size = (unsigned)getaddr(f->esp+0xc);
 		struct file* ofile;
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		if(!goodfd(fd)){
 			sysexit(-1);
 			return;
@@ -320,7 +326,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 	else if(syscallnum == SYS_SEEK){
 		int fd = (int)getaddr(f->esp+0x4);
 		unsigned position = (unsigned) getaddr(f->esp+0x8);
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		struct file *ofile;
 		if(!goodfd(fd)){
 			sysexit(-1);
@@ -340,7 +346,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 	}
 	else if(syscallnum == SYS_TELL){
 		int fd = (int)getaddr(f->esp+0x4);
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		struct file *ofile;
 		if(!goodfd(fd)){
 			sysexit(-1);
@@ -364,7 +370,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 		//this systemcall is about close
 		int fd = getaddr(f->esp+0x4);
 		struct file* ofile;
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		if(!goodfd(fd)){
 			sysexit(-1);
 			return;
@@ -390,7 +396,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 	else if(syscallnum == SYS_MMAP){
 		int fd = (int)getaddr(f->esp+0x4);
 		void *addr = (void *)getaddr(f->esp+0x08);
-		struct thread *cur = thread_current();
+		struct thread *cur = thread_current()->process;
 		struct file* ofile;
 		//fd 0Ǵ 1ϰ map Ұ
 		if(fd == 0 || fd == 1){
@@ -460,7 +466,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 			go_page++;
 		}
 		//mmap table ߰
-		struct mmap_elem *me = (struct mmap_elem *)malloc(sizeof(struct mmap_elem));
+		struct mmap_elem *me = kmem_cache_alloc(mmap_cache);
 		me->map_pid = fd;	//mapid_t  fd   
 		me->mfd = fd;
 		me->mfile = ofile;
@@ -472,7 +478,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 	}
 	else if(syscallnum == SYS_MUNMAP){
 		int mapping  = (int)getaddr(f->esp+0x04);
-		struct thread* cur = thread_current();
+		struct thread* cur = thread_current()->process;
 		struct mmap_elem* me = find_mmap(&(cur->mmap_table), mapping);
 		int fd = me->mfd;
 		if(!goodfd(fd)){
@@ -481,7 +487,65 @@ syscall_handler (struct intr_frame *f UNUSED)
 		}
 		sys_unmmap(cur, me);
 		list_remove(&me->lelem);
-		free(me);
+		kmem_cache_free(mmap_cache, me);
+	}
+	else if(syscallnum == SYS_SET_TICKETS){
+		//join the stride class with TICKETS tickets, or leave it with 0
+		//returns the previous ticket count, or -1 if TICKETS is out of range
+		int tickets = getaddr(f->esp+0x4);
+		if(tickets < 0 || tickets > TICKETS_MAX){
+			f->eax = -1;
+			return;
+		}
+		f->eax = thread_get_tickets();
+		thread_set_tickets(tickets);
+	}
+	else if(syscallnum == SYS_THREAD_STATS){
+		//copy the calling thread's scheduling statistics to STATS
+		struct thread_stats *stats = (struct thread_stats *)getaddr(f->esp+0x4);
+		if(!goodfileptr(stats) || !goodfileptr((char *)stats + sizeof *stats - 1)){
+			sysexit(-1);
+			return;
+		}
+		thread_get_stats(stats);
+		f->eax = true;
+	}
+	else if(syscallnum == SYS_THREAD_CREATE){
+		//start a thread of this process at EIP with two arguments
+		void (*eip) (void) = (void (*) (void))getaddr(f->esp+0x4);
+		void *arg0 = (void *)getaddr(f->esp+0x8);
+		void *arg1 = (void *)getaddr(f->esp+0xc);
+		if(!goodfileptr((void *)eip)){
+			sysexit(-1);
+			return;
+		}
+		f->eax = process_thread_create(eip, arg0, arg1);
+	}
+	else if(syscallnum == SYS_THREAD_EXIT){
+		//the process thread cannot end alone, so for it this is exit(0)
+		struct thread *cur = thread_current();
+		if(cur->process == cur){
+			sysexit(0);
+			return;
+		}
+		cur->thread_exited = true;
+		thread_exit();
+	}
+	else if(syscallnum == SYS_THREAD_JOIN){
+		tid_t tid = (tid_t)getaddr(f->esp+0x4);
+		f->eax = process_thread_join(tid);
+	}
+	else if(syscallnum == SYS_FUTEX_WAIT || syscallnum == SYS_FUTEX_WAKE){
+		int *addr = (int *)getaddr(f->esp+0x4);
+		int arg = getaddr(f->esp+0x8);
+		if(!goodfileptr(addr) || (uintptr_t)addr % sizeof *addr != 0){
+			sysexit(-1);
+			return;
+		}
+		if(syscallnum == SYS_FUTEX_WAIT)
+			f->eax = process_futex_wait(addr, arg);
+		else
+			f->eax = process_futex_wake(addr, arg);
 	}
 	else{//if the syscallnum is out of contol
 		//bad sp
@@ -519,19 +583,3 @@ bool goodfileptr(void *fileptr){
 	}
 	return true;
 }
-int makeP_C(tid_t t){
-	struct thread *cur = thread_current();
-	struct list *elist = &execute_list;
-	struct list_elem *e;
-	struct thread *ex;
-	if(!list_empty(elist)){
-		for(e = list_begin(elist); e!=list_end(elist); e=list_next(e)){
-			ex = list_entry(e, struct thread, e_elem);
-			if(ex->tid == t && ex->child_exit_status>=0){
-				ex->parent_id = cur; 
-				return t;
-			}
-		}
-	}
-	return -1;
-}
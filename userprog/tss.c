@@ -2,6 +2,10 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
+#include "threads/flags.h"
+#include "threads/init.h"
+#include "threads/kstack.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -47,7 +51,16 @@
    See [IA32-v3a] 6.2.1 "Task-State Segment (TSS)" for a
    description of the TSS.  See [IA32-v3a] 5.12.1 "Exception- or
    Interrupt-Handler Procedures" for a description of when and
-   how stack switching occurs during an interrupt. */
+   how stack switching occurs during an interrupt.
+
+   There is one more TSS, for double faults.  A kernel stack
+   that overflows faults on its guard page (see kstack.c), and
+   the processor cannot push the page fault's frame onto the
+   same stack, so it raises a double fault instead.  Handling
+   that through an ordinary gate would fault a third time and
+   reset the machine, so vector 8 is a task gate that switches to
+   a task with a stack of its own, which reports the overflow.
+   See [IA32-v3a] 6.3 "Task Switching". */
 struct tss
   {
     uint16_t back_link, :16;
@@ -72,35 +85,104 @@ struct tss
     uint16_t trace, bitmap;
   };
 
-/* Kernel TSS. */
-static struct tss *tss;
+/* Kernel TSS of each CPU, indexed by CPU id. */
+static struct tss *tss[CPU_MAX];
+
+/* Double fault TSS of each CPU, at the bottom of the page whose
+   top is its task's stack. */
+static struct tss *df_tss[CPU_MAX];
+
+static void double_fault (void) NO_RETURN;
 
-/* Initializes the kernel TSS. */
+/* Initializes the bootstrap processor's TSSes. */
 void
 tss_init (void) 
 {
+  tss_create (0);
+  tss_update ();
+}
+
+/* Creates the TSSes of CPU, which gdt_init() or gdt_init_ap()
+   then loads. */
+void
+tss_create (int cpu) 
+{
+  struct tss *t, *df;
+
+  ASSERT (cpu >= 0 && cpu < CPU_MAX);
+  ASSERT (tss[cpu] == NULL);
+
   /* Our TSS is never used in a call gate or task gate, so only a
      few fields of it are ever referenced, and those are the only
      ones we initialize. */
-  tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
-  tss->ss0 = SEL_KDSEG;
-  tss->bitmap = 0xdfff;
-  tss_update ();
+  t = tss[cpu] = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  t->ss0 = SEL_KDSEG;
+  t->bitmap = 0xdfff;
+
+  df = df_tss[cpu] = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  df->cr3 = vtop (base_page_dir);
+  df->eip = double_fault;
+  df->eflags = FLAG_MBS;
+  df->esp = (uint32_t) df + PGSIZE;
+  df->cs = SEL_KCSEG;
+  df->ss = df->ds = df->es = SEL_KDSEG;
+  df->fs = df->gs = SEL_KDSEG;
+  df->ss0 = SEL_KDSEG;
+  df->bitmap = 0xdfff;
+}
+
+/* Returns CPU's kernel TSS. */
+struct tss *
+tss_get (int cpu) 
+{
+  ASSERT (tss[cpu] != NULL);
+  return tss[cpu];
 }
 
-/* Returns the kernel TSS. */
+/* Returns CPU's double fault TSS. */
 struct tss *
-tss_get (void) 
+tss_get_double_fault (int cpu) 
 {
-  ASSERT (tss != NULL);
-  return tss;
+  ASSERT (df_tss[cpu] != NULL);
+  return df_tss[cpu];
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
-   of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to
+   point to the end of the thread stack. */
 void
 tss_update (void) 
 {
-  ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  struct tss *t = tss[cpu_current ()->id];
+
+  ASSERT (t != NULL);
+  t->esp0 = kstack_top (thread_current ());
+}
+
+/* Runs as its own task on a double fault, with interrupts off.
+   The processor saved the state of the faulting code in the
+   kernel TSS of the CPU that faulted, which is the one whose
+   double fault TSS shares a page with our stack.  Nothing can be
+   recovered, so this just reports what happened. */
+static void
+double_fault (void) 
+{
+  struct tss *df = pg_round_down (&df);
+  struct tss *fault_tss = NULL;
+  void *fault_addr;
+  int i;
+
+  for (i = 0; i < CPU_MAX; i++)
+    if (df_tss[i] == df)
+      fault_tss = tss_get (i);
+  ASSERT (fault_tss != NULL);
+
+  asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  if (kstack_is_guard (fault_addr))
+    {
+      struct thread *t = kstack_owner (fault_addr);
+      PANIC ("kernel stack overflow in thread %s (tid %d) at eip %p",
+             t->name, t->tid, (void *) fault_tss->eip);
+    }
+  PANIC ("double fault at eip %p, esp %p",
+         (void *) fault_tss->eip, (void *) fault_tss->esp);
 }
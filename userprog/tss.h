@@ -5,7 +5,9 @@
 
 struct tss;
 void tss_init (void);
-struct tss *tss_get (void);
+void tss_create (int cpu);
+struct tss *tss_get (int cpu);
+struct tss *tss_get_double_fault (int cpu);
 void tss_update (void);
 
 #endif /* userprog/tss.h */
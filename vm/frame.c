@@ -1,34 +1,68 @@
 #include "frame.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #include "vm/swap.h"
 #include "vm/page.h"
 #include "userprog/pagedir.h"
+#include "devices/timer.h"
 
 #include <stdio.h>
 
 struct list_elem *victim_cur;
+static struct kmem_cache *fte_cache;
+
+/* How long reclaim_frames() waits for the worker, in timer ticks. */
+#define RECLAIM_WAIT 4
+
+static struct work reclaim_work;
+static size_t reclaim_want;	//frames asked for by reclaim_frames()
+static size_t reclaimed;	//frames reclaim_worker() has freed, ever
+
+static struct fte *pick_victim(struct pt **);
+static void evict(struct fte *, struct pt *);
+static void free_frame(struct fte *);
+static size_t reclaim_frames(size_t);
+static void reclaim_worker(void *);
 
 void init_frame(){
 	list_init(&frame_table);
-	sema_init(&frame_sema, 1);
+	adaptive_lock_init(&frame_lock, "frame table");
 	victim_cur = NULL;
+	fte_cache = kmem_cache_create("fte", sizeof(struct fte), NULL);
+	work_init(&reclaim_work, reclaim_worker, NULL);
+	palloc_set_reclaim(PAL_USER, reclaim_frames);
 }
 
 void insert_frame(struct fte * fte){
-	sema_down(&frame_sema);
+	adaptive_lock_acquire(&frame_lock);
 	list_push_back(&frame_table, &fte->lelem);
-	sema_up(&frame_sema);
+	adaptive_lock_release(&frame_lock);
 }
 
 
-void delete_frame(struct fte *fte){
+/* Frees the frame at PADDR, whose page has been unmapped and taken
+ * out of its page table.  A frame being evicted is no longer in the
+ * frame table, and evict() frees it instead. */
+void delete_frame(void *paddr){
+	struct fte *fte;
+	adaptive_lock_acquire(&frame_lock);
+	fte = find_frame(paddr);
+	if(fte != NULL)
+		list_remove(&fte->lelem);
+	adaptive_lock_release(&frame_lock);
+	if(fte != NULL)
+		free_frame(fte);
+}
+
+/* Frees FTE, which is in no list, and its frame. */
+static void free_frame(struct fte *fte){
 	palloc_free_page(fte->paddr);
-	sema_down(&frame_sema);
-	list_remove(&fte->lelem);
-	sema_up(&frame_sema);
-	free(fte);
+	kmem_cache_free(fte_cache, fte);
 }
 
+/* Returns the frame table entry for the frame at PADDR, or a null
+ * pointer if there is none.  The caller must hold frame_lock. */
 struct fte *find_frame(void *paddr){
 	struct list_elem *e;
 	struct list *flist =  &frame_table;
@@ -43,7 +77,7 @@ struct fte *find_frame(void *paddr){
 }
 
 struct fte *make_frame_entry(void *vaddr, void *paddr, struct thread* t){
-	struct fte* newfte = (struct fte *)malloc(sizeof(struct fte));
+	struct fte* newfte = kmem_cache_alloc(fte_cache);
 	newfte->paddr = paddr;
 	newfte->vaddr = vaddr;
 	newfte->owner = t;
@@ -51,26 +85,94 @@ struct fte *make_frame_entry(void *vaddr, void *paddr, struct thread* t){
 	newfte->reference = 0;
 	return newfte;
 }
-void evict_frame(){
-	struct list *flist = &frame_table;
+/* Evicts a frame, for a user pool allocation that failed.  Returns
+ * false if there was no frame to evict. */
+bool evict_frame(){
+	struct pt *pt;
+	struct fte *fte = pick_victim(&pt);
+	if(fte == NULL)
+		return false;
+	evict(fte, pt);
+	return true;
+}
+
+/* Takes the next victim out of the frame table and marks it EVICT,
+ * so that nobody else evicts or frees it, and returns it with its
+ * owner's page table in *PT, locked for writing.  Returns a null
+ * pointer if the frame table is empty.
+ *
+ * pt_lock is taken before frame_lock is dropped, in lock order.
+ * Until then the owner cannot be gone: it frees its frames only
+ * after taking frame_lock.  From then on its page table cannot be,
+ * because destroying it takes pt_lock. */
+static struct fte *pick_victim(struct pt **pt){
 	struct fte *fte = NULL;
-	if(true){
-		victim_cur = list_begin(flist);
-		fte = list_entry(victim_cur, struct fte, lelem);
-//		printf("Victim : %x <--- %x(%x)\n",  (unsigned int)fte->vaddr, (unsigned int)fte->paddr, (unsigned int)fte->reference);
+	adaptive_lock_acquire(&frame_lock);
+	if(!list_empty(&frame_table)){
+		fte = list_entry(list_pop_front(&frame_table), struct fte, lelem);
+		fte->state = EVICT;
+		*pt = fte->owner->page_table;
+		rwlock_acquire_write(&(*pt)->pt_lock);
 	}
-	struct pte *pte = NULL;
-	pte = find_page(fte->owner->page_table, fte->vaddr);
+	adaptive_lock_release(&frame_lock);
+	return fte;
+}
+
+/* Writes the page in FTE, which pick_victim() returned along with
+ * PT, out to swap, and frees the frame.  If its owner has meanwhile
+ * taken the page out of PT, only frees the frame. */
+static void evict(struct fte *fte, struct pt *pt){
+	struct pte *pte = find_page(pt, fte->vaddr);
+	TRACE(TRACE_EVICT, fte->vaddr, fte->owner->tid);
 
-	pte->disk_ind = swap_out(fte->paddr);
-	pte->loc = SWP;
+	if(pte != NULL && pte->loc == MEM && pte->paddr == fte->paddr){
+		//unmap it first, so that no write to the page after swap_out()
+		//is lost: the write faults and waits for pt_lock instead
+		free_page(fte->owner->pagedir, fte->vaddr);
 
-	//page table entry 
-	free_page(fte->owner->pagedir, fte->vaddr);
+		pte->disk_ind = swap_out(fte->paddr);
+		pte->loc = SWP;
+	}
+	rwlock_release_write(&pt->pt_lock);
 
 	//frame table entry 
-	delete_frame(fte);
-	
+	free_frame(fte);
+}
+
+/* Reclaim function for the user pool.  It runs inside a failed
+ * kernel palloc, whose caller may hold any lock, so it must not
+ * evict there and then: that takes the frame table and page table
+ * locks and writes to swap.  Instead it asks a worker thread to
+ * evict up to CNT frames and, if it may sleep, waits up to
+ * RECLAIM_WAIT ticks for it, so that the caller can retry.  The
+ * worker may need a lock the caller holds, so the wait is bounded.
+ * Returns the number of frames freed meanwhile. */
+static size_t reclaim_frames(size_t cnt){
+	size_t start = reclaimed;
+	size_t want;
+	int i;
+	do
+		want = reclaim_want;
+	while(want < cnt && !__sync_bool_compare_and_swap(&reclaim_want, want, cnt));
+	work_queue(&reclaim_work, WORK_NORMAL);
+
+	if(intr_context() || intr_get_level() == INTR_OFF)
+		return 0;
+	for(i = 0; i < RECLAIM_WAIT && reclaimed - start < cnt; i++)
+		timer_sleep(1);
+	return reclaimed - start;
+}
+
+/* Evicts the frames that reclaim_frames() asked for, then moves
+ * the pages freed on to free memory, where the kernel pool can
+ * take them.  Runs on a worker thread, which holds no locks. */
+static void reclaim_worker(void *aux UNUSED){
+	size_t cnt = __sync_lock_test_and_set(&reclaim_want, 0);
+	size_t done = 0;
+	while(done < cnt && evict_frame())
+		done++;
+	palloc_flush(PAL_USER);
+	__sync_fetch_and_add(&reclaimed, done);
 }
 
 //debugging
@@ -8,26 +8,27 @@
 
 #define FREE 0
 #define ALLOC 1
+#define EVICT 2	//taken out of frame_table by pick_victim() for eviction
 
 struct fte{
 	void* paddr; //Frame Number
 	void* vaddr; //Page Number
-	bool state; //frame allocated Ǿ ִ free 
+	int state; //frame allocated Ǿ ִ free 
 	struct thread *owner; //allocate Ǿٸ  Ǿ
 	bool reference;	//reference bit, Swap  bit
 	struct list_elem lelem;
 };
 
 struct list frame_table; //global frame table
-struct semaphore frame_sema;
+struct adaptive_lock frame_lock; //taken before any pt_lock (see vm/page.h)
 
 void init_frame(void);
 struct fte *make_frame_entry(void *, void *, struct thread *);
 void insert_frame(struct fte *);
-void delete_frame(struct fte *);
+void delete_frame(void *);
 struct fte* find_frame(void *);
 
-void evict_frame(void);
+bool evict_frame(void);
 
 //debuggin
 void print_frame_table(void);
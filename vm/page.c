@@ -1,9 +1,19 @@
 #include "page.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "vm/frame.h"
 
 #include <stdio.h>
 
+static struct kmem_cache *pte_cache;
+static struct kmem_cache *pt_cache;
+
+/* Creates the page table caches.  Must be called before the
+ * first thread is created, since every thread gets a page table. */
+void init_page(void){
+	pte_cache = kmem_cache_create("pte", sizeof(struct pte), NULL);
+	pt_cache = kmem_cache_create("pt", sizeof(struct pt), NULL);
+}
+
 //page table  hash_function
 static unsigned
 page_hash (const struct hash_elem *e, void *aux UNUSED)
@@ -25,7 +35,7 @@ page_less (const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSE
  * uaddr kaddr Ͽ ο page table entry  
 */
 struct pte* make_page_entry(void *uaddr, void *kaddr){
-	struct pte* newpte = (struct pte *)malloc(sizeof(struct pte));
+	struct pte* newpte = kmem_cache_alloc(pte_cache);
 	newpte->vaddr = uaddr;
 	newpte->paddr = kaddr;
 	return newpte;
@@ -36,25 +46,38 @@ struct pte* make_page_entry(void *uaddr, void *kaddr){
 */
 
 struct pt* init_page_table(){
-	struct pt* new_pt = (struct pt *)malloc(sizeof(struct pt));
+	struct pt* new_pt = kmem_cache_alloc(pt_cache);
 	hash_init(&new_pt->page_table, page_hash, page_less, NULL);
-	sema_init(&new_pt->pt_sema, 1);
+	rwlock_init(&new_pt->pt_lock);
 	return new_pt;
 }
 
+/* Removes PTE from PT, whose pt_lock the caller holds for writing.
+ * Once the lock is released, the caller frees PTE's memory with
+ * release_page(). */
 bool delete_page(struct pt *pt, struct pte* pte){
-	if(hash_delete(&pt->page_table, &pte->helem) != NULL){
-		free(pte);
-		return true;
+	return hash_delete(&pt->page_table, &pte->helem) != NULL;
+}
+
+/* Frees the frame or swap slot of PTE, which delete_page() has
+ * removed from its page table, unmapping it from page directory
+ * PD, and then PTE itself.  This touches the frame table, so the
+ * caller must not hold pt_lock. */
+void release_page(uint32_t *pd, struct pte *pte){
+	if(pte->loc == MEM){
+		free_page(pd, pte->vaddr);
+		delete_frame(pte->paddr);
 	}
-	return false;
+	else if(pte->loc == SWP)
+		swap_free(pte->disk_ind);
+	kmem_cache_free(pte_cache, pte);
 }
 
 
 /*  ̺ Entry  */
 static void pte_destroy (struct hash_elem *e, void *aux UNUSED)
 {
-	free (hash_entry(e, struct pte, helem));
+	kmem_cache_free (pte_cache, hash_entry(e, struct pte, helem));
 }
 
 static void pte_clean (struct hash_elem *e, void *aux UNUSED)
@@ -63,16 +86,11 @@ static void pte_clean (struct hash_elem *e, void *aux UNUSED)
 	struct pte *pte;
 	pte = hash_entry (e, struct pte, helem);
 	if(pte->loc == MEM){
-		struct fte *fte = NULL;
-		void *pagedir_frame = pagedir_get_page(cur->pagedir, pte->vaddr);
 		//޸  ִ page 
-		fte = find_frame(pagedir_frame);
-		if(fte){
-			// 丮 
-			pagedir_clear_page(cur->pagedir, fte->vaddr);
-			//frame 
-			delete_frame(fte);
-		}
+		// 丮 
+		pagedir_clear_page(cur->pagedir, pte->vaddr);
+		//frame  (unless it is being evicted: evict() frees it)
+		delete_frame(pte->paddr);
 	}
 	else if(pte->loc == SWP){
 		//SWAP diskȿ ִ°
@@ -80,25 +98,43 @@ static void pte_clean (struct hash_elem *e, void *aux UNUSED)
 	}
 }
 
+/* Frees every entry of PT, and the frames and swap slots they
+   use, but keeps PT itself so that it can be reused.  The entries
+   are moved out of PT under pt_lock, so that eviction no longer
+   finds them, and their frames freed after it is released. */
+void clear_page_table(struct pt* pt){
+	struct hash old;
+	if (pt == NULL)
+		return;
+	rwlock_acquire_write(&pt->pt_lock);
+	old = pt->page_table;
+	hash_init(&pt->page_table, page_hash, page_less, NULL);
+	rwlock_release_write(&pt->pt_lock);
+
+	hash_apply(&old, pte_clean);
+	hash_destroy(&old, pte_destroy);
+}
+
+/* Frees PT along with its entries, as clear_page_table() does. */
 void destroy_page_table(struct pt* pt){
 	if (pt == NULL)
 		return;
-	// frame  丮 free Ŵ
-	hash_apply(&pt->page_table, pte_clean);
+	clear_page_table(pt);
 	//׸ page  entry freeŴ
-	hash_destroy(&pt->page_table, pte_destroy);
+	hash_destroy(&pt->page_table, NULL);
 	// page_table ü freeŴ
-	free(pt);
+	kmem_cache_free(pt_cache, pt);
 }
 
 /* page table Entry߰ */
 void insert_page(struct pt *pt, struct pte *pte){
-//	sema_down(&pt->pt_sema);
+	rwlock_acquire_write(&pt->pt_lock);
 	hash_insert(&pt->page_table, &pte->helem);
-//	sema_up(&pt->pt_sema);
+	rwlock_release_write(&pt->pt_lock);
 }
 
-/* find pte from vaddr */
+/* find pte from vaddr.  The caller must hold PT's pt_lock, and may
+ * use the pte only until releasing it. */
 struct pte *find_page(struct pt *pt, void *vaddr){
 	struct pte for_find;
 	struct pte *pte = NULL;
@@ -109,6 +145,49 @@ struct pte *find_page(struct pt *pt, void *vaddr){
 	return pte;
 }
 
+/* Adds CNT writable, zero-filled pages starting at UPAGE to PT,
+ * to be faulted in on first use.  Adds nothing and returns false
+ * if any of them is already in PT. */
+bool reserve_pages(struct pt *pt, void *upage, size_t cnt){
+	struct pte for_find;
+	size_t i;
+	rwlock_acquire_write(&pt->pt_lock);
+	for(i = 0; i < cnt; i++){
+		for_find.vaddr = upage + i*PAGE_SIZE;
+		if(hash_find(&pt->page_table, &for_find.helem) != NULL){
+			rwlock_release_write(&pt->pt_lock);
+			return false;
+		}
+	}
+	for(i = 0; i < cnt; i++){
+		struct pte *pte = make_page_entry(upage + i*PAGE_SIZE, NULL);
+		pte->loc = ALZ;
+		pte->writable = true;
+		pte->file = NULL;
+		pte->ofs = 0;
+		pte->file_size = 0;
+		hash_insert(&pt->page_table, &pte->helem);
+	}
+	rwlock_release_write(&pt->pt_lock);
+	return true;
+}
+
+/* Removes the CNT pages starting at UPAGE from PT and page
+ * directory PD, freeing their frames and swap slots. */
+void release_pages(struct pt *pt, uint32_t *pd, void *upage, size_t cnt){
+	size_t i;
+	for(i = 0; i < cnt; i++){
+		struct pte *pte;
+		rwlock_acquire_write(&pt->pt_lock);
+		pte = find_page(pt, upage + i*PAGE_SIZE);
+		if(pte != NULL)
+			delete_page(pt, pte);
+		rwlock_release_write(&pt->pt_lock);
+		if(pte != NULL)
+			release_page(pd, pte);
+	}
+}
+
 /* page ϳ Ҵ
  *  Ҵ  evict Ѵ Ҵ
  */
@@ -116,7 +195,10 @@ void *get_page(enum palloc_flags flag){
 	void *page = palloc_get_page(flag);
 	//if now page allcated, then evict some frame
 	while(page == NULL){
-		evict_frame();
+		//with no frame to evict, the frames being evicted are freed
+		//by other threads
+		if(!evict_frame())
+			thread_yield();
 		page = palloc_get_page(flag);
 	}
 	return page;
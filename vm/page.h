@@ -29,13 +29,26 @@ struct pte{
 	int file_size;
 };
 
-//page table
+/* Page table.
+ *
+ * pt_lock guards the table and its entries: lookups take it
+ * shared, anything that adds, removes or changes an entry takes it
+ * exclusive.  find_page() and delete_page() must be called with it
+ * held, and the entry find_page() returns is only valid until it is
+ * released.
+ *
+ * Lock order: frame_lock, then pt_lock.  Code holding pt_lock must
+ * not touch the frame table, so it detaches what it needs under
+ * pt_lock and frees frames after releasing it. */
 struct pt{
 	struct hash page_table;
-	struct semaphore pt_sema;
+	struct rwlock pt_lock;
 };
 
+void init_page(void);
+
 struct pt* init_page_table(void);
+void clear_page_table(struct pt*);
 void destroy_page_table(struct pt*);
 
 
@@ -43,8 +56,12 @@ struct pte *make_page_entry(void *, void *);
 
 void insert_page(struct pt *, struct pte *);
 bool delete_page(struct pt *, struct pte *);
+void release_page(uint32_t *, struct pte *);
 struct pte *find_page(struct pt *, void *);
 
+bool reserve_pages(struct pt *, void *, size_t);
+void release_pages(struct pt *, uint32_t *, void *, size_t);
+
 void *get_page(enum palloc_flags);
 void free_page(void *, void *);
 